@@ -0,0 +1,369 @@
+#include "Flash.hpp"
+
+#include <thread>
+#include <cstring>
+#include <algorithm>
+
+namespace LC4500 {
+	namespace DLPC350 {
+		namespace {
+			inline bool send(Transaction &tran, bool ackRequired) {
+				tran.flags.reply = ackRequired;
+				if (!ackRequired) return (write(tran) > 0);
+				return (transact(tran) != nullptr);
+			}
+
+			inline TransactionData<uint8_t> readBootloader(uint8_t param) {
+				auto tran = Transaction(Transaction::Type::READ, 0x0015, std::forward<uint8_t>(param));
+				return transact(tran);
+			}
+
+			inline double seconds(std::chrono::steady_clock::duration duration) {
+				return std::chrono::duration<double>(duration).count();
+			}
+		};
+
+		/**
+		* enterProgrammingMode
+		* CMD2 : 0x30, CMD3 : 0x01, Param : 1
+		*/
+		bool enterProgrammingMode() {
+			auto tran = Transaction(Transaction::Type::WRITE, 0x3001, static_cast<uint8_t>(1));
+			return send(tran, false);
+		}
+
+		/**
+		* exitProgrammingMode
+		* CMD2 : 0x00, CMD3 : 0x30, Param : 1
+		*/
+		bool exitProgrammingMode() {
+			auto tran = Transaction(Transaction::Type::WRITE, 0x0030, static_cast<uint8_t>(2));
+			return send(tran, false);
+		}
+
+		/**
+		* getFlashManufacturerID
+		* CMD2 : 0x00, CMD3 : 0x15, Param : 1 (0x0C)
+		*/
+		std::unique_ptr<uint16_t> getFlashManufacturerID() {
+			auto result = readBootloader(0x0C);
+			if (result == nullptr) return nullptr;
+			return std::unique_ptr<uint16_t>(new uint16_t(result.get()[6] | (result.get()[7] << 8)));
+		}
+
+		/**
+		* getFlashDeviceID
+		* CMD2 : 0x00, CMD3 : 0x15, Param : 1 (0x0D)
+		*/
+		std::unique_ptr<uint64_t> getFlashDeviceID() {
+			auto result = readBootloader(0x0D);
+			if (result == nullptr) return nullptr;
+
+			uint64_t id = 0;
+			for (size_t i = 0; i < 4; i++) id |= static_cast<uint64_t>(result.get()[6 + i]) << (8 * i);
+			for (size_t i = 0; i < 4; i++) id |= static_cast<uint64_t>(result.get()[12 + i]) << (8 * (i + 4));
+			return std::unique_ptr<uint64_t>(new uint64_t(id));
+		}
+
+		/**
+		* getBootloaderStatus
+		* CMD2 : 0x00, CMD3 : 0x15, Param : 1 (0x00)
+		* Byte 0 of any bootloader readback is the status.
+		*/
+		std::unique_ptr<uint8_t> getBootloaderStatus() {
+			auto result = readBootloader(0x00);
+			if (result == nullptr) return nullptr;
+			return std::unique_ptr<uint8_t>(new uint8_t(result.get()[0]));
+		}
+
+		/**
+		* setFlashType
+		* CMD2 : 0x00, CMD3 : 0x2F, Param : 1
+		*/
+		bool setFlashType(uint8_t type) {
+			auto tran = Transaction(Transaction::Type::WRITE, 0x002F, std::forward<uint8_t>(type));
+			return send(tran, true);
+		}
+
+		/**
+		* setFlashAddress
+		* CMD2 : 0x00, CMD3 : 0x29, Param : 4
+		*/
+		bool setFlashAddress(uint32_t address) {
+			auto tran = Transaction(Transaction::Type::WRITE, 0x0029, std::forward<uint32_t>(address));
+			return send(tran, true);
+		}
+
+		/**
+		* eraseFlashSector
+		* CMD2 : 0x00, CMD3 : 0x28
+		*/
+		bool eraseFlashSector() {
+			auto tran = Transaction(Transaction::Type::WRITE, 0x0028);
+			return send(tran, true);
+		}
+
+		/**
+		* setFlashUploadSize
+		* CMD2 : 0x00, CMD3 : 0x2C, Param : 4
+		*/
+		bool setFlashUploadSize(uint32_t size) {
+			auto tran = Transaction(Transaction::Type::WRITE, 0x002C, std::forward<uint32_t>(size));
+			return send(tran, true);
+		}
+
+		/**
+		* uploadFlashData
+		* CMD2 : 0x00, CMD3 : 0x25, Param : size
+		*/
+		bool uploadFlashData(const uint8_t *data, size_t size) {
+			assert(size <= maxFlashUploadSize);
+
+			auto tran = Transaction(Transaction::Type::WRITE, 0x0025);
+			memcpy(&tran.data[tran.length], data, size);
+			tran.length += static_cast<uint16_t>(size);
+			return send(tran, false);
+		}
+
+		/**
+		* calculateFlashChecksum
+		* CMD2 : 0x00, CMD3 : 0x26
+		*/
+		bool calculateFlashChecksum() {
+			auto tran = Transaction(Transaction::Type::WRITE, 0x0026);
+			return send(tran, true);
+		}
+
+		/**
+		* getFlashChecksum
+		* CMD2 : 0x00, CMD3 : 0x15, Param : 1 (0x00)
+		*/
+		std::unique_ptr<uint32_t> getFlashChecksum() {
+			auto result = readBootloader(0x00);
+			if (result == nullptr) return nullptr;
+			return std::unique_ptr<uint32_t>(new uint32_t(result.get()[6] | (result.get()[7] << 8) | (result.get()[8] << 16) | (static_cast<uint32_t>(result.get()[9]) << 24)));
+		}
+
+		bool waitForFlashReady(std::chrono::milliseconds timeout) {
+			auto deadline = std::chrono::steady_clock::now() + timeout;
+			std::chrono::microseconds backoff(50);
+
+			while (true) {
+				auto status = getBootloaderStatus();
+				if (status == nullptr) return false;
+				if ((*status & bootloaderFlashBusy) == 0) return true;
+				if (std::chrono::steady_clock::now() >= deadline) return false;
+
+				std::this_thread::sleep_for(backoff);
+				backoff = std::min(backoff * 2, std::chrono::microseconds(10000));
+			}
+		}
+
+		uint32_t computeFlashChecksum(const uint8_t *data, size_t size) {
+			uint32_t checksum = 0;
+			for (size_t i = 0; i < size; i++) checksum += data[i];
+			return checksum;
+		}
+
+		size_t FlashSectorMap::sectorOf(uint32_t address) const {
+			if (sectors.empty() || address < sectors.front() || address >= size) return sectors.size();
+			auto it = std::upper_bound(sectors.begin(), sectors.end(), address);
+			return static_cast<size_t>(it - sectors.begin()) - 1;
+		}
+
+		std::pair<size_t, size_t> FlashSectorMap::sectorsIn(uint32_t begin, uint32_t end) const {
+			end = std::min(end, size);
+			if (begin >= end) return std::make_pair(sectors.size(), sectors.size());
+
+			size_t first = sectorOf(begin);
+			if (first == sectors.size()) return std::make_pair(sectors.size(), sectors.size());
+
+			auto last = std::lower_bound(sectors.begin(), sectors.end(), end);
+			return std::make_pair(first, static_cast<size_t>(last - sectors.begin()));
+		}
+
+		void FlashProgrammer::report(Stage stage, size_t done, size_t total) {
+			if (!progressCallback) return;
+
+			Progress progress;
+			progress.stage = stage;
+			progress.done = done;
+			progress.total = total;
+			progress.elapsed = seconds(Clock::now() - started);
+			progress.throughput = (stats.programTime > 0) ? stats.uploadedBytes / stats.programTime / 1e6 : 0;
+			progressCallback(progress);
+		}
+
+		bool FlashProgrammer::eraseSectors(const std::vector<size_t> &indices) {
+			auto begin = Clock::now();
+
+			for (size_t i = 0; i < indices.size(); i++) {
+				if (!setFlashAddress(sectorMap.sectorBegin(indices[i])) || !eraseFlashSector() || !waitForFlashReady()) return false;
+				stats.erasedSectors++;
+				report(Stage::ERASE, i + 1, indices.size());
+			}
+
+			stats.eraseTime += seconds(Clock::now() - begin);
+			return true;
+		}
+
+		/**
+		* uploadSectors
+		* Uploads runs of consecutive non-blank sectors, clipped to [begin, end), one address/size
+		* setup per run and the data chunks back to back.
+		*/
+		bool FlashProgrammer::uploadSectors(const uint8_t *image, const std::vector<size_t> &indices, uint32_t begin, uint32_t end) {
+			auto programBegin = Clock::now();
+			auto isBlank = [&](size_t index) {
+				uint32_t from = std::max(sectorMap.sectorBegin(index), begin), to = std::min(sectorMap.sectorEnd(index), end);
+				return std::all_of(image + from, image + to, [](uint8_t value) { return value == 0xFF; });
+			};
+
+			size_t total = 0, done = 0, chunks = 0;
+			for (auto index : indices) total += std::min(sectorMap.sectorEnd(index), end) - std::max(sectorMap.sectorBegin(index), begin);
+
+			for (size_t i = 0; i < indices.size();) {
+				if (isBlank(indices[i])) {
+					done += std::min(sectorMap.sectorEnd(indices[i]), end) - std::max(sectorMap.sectorBegin(indices[i]), begin);
+					stats.skippedSectors++;
+					i++;
+					continue;
+				}
+
+				size_t last = i;
+				while (last + 1 < indices.size() && indices[last + 1] == indices[last] + 1 && !isBlank(indices[last + 1])) last++;
+
+				uint32_t from = std::max(sectorMap.sectorBegin(indices[i]), begin), to = std::min(sectorMap.sectorEnd(indices[last]), end);
+				if (!setFlashAddress(from) || !setFlashUploadSize(to - from)) return false;
+
+				for (uint32_t address = from; address < to;) {
+					size_t size = std::min<size_t>(to - address, maxFlashUploadSize);
+					if (!uploadFlashData(image + address, size)) return false;
+
+					address += static_cast<uint32_t>(size);
+					done += size;
+					stats.uploadedBytes += size;
+					stats.programTime = seconds(Clock::now() - programBegin);
+					if (++chunks % 64 == 0) report(Stage::PROGRAM, done, total);
+				}
+
+				if (!waitForFlashReady()) return false;
+				i = last + 1;
+			}
+
+			stats.programTime = seconds(Clock::now() - programBegin);
+			stats.throughput = (stats.programTime > 0) ? stats.uploadedBytes / stats.programTime / 1e6 : 0;
+			report(Stage::PROGRAM, total, total);
+			return true;
+		}
+
+		std::unique_ptr<uint32_t> FlashProgrammer::deviceChecksum(uint32_t begin, uint32_t end) {
+			if (!setFlashAddress(begin) || !setFlashUploadSize(end - begin) || !calculateFlashChecksum() || !waitForFlashReady()) return nullptr;
+			return getFlashChecksum();
+		}
+
+		/**
+		* compareSectors
+		* Appends to `changed` the sectors in [first, last] whose device checksum differs from the image.
+		* Each sector is checked on its own: over a wider range, changes in different sectors can cancel out.
+		*/
+		bool FlashProgrammer::compareSectors(const uint8_t *image, size_t first, size_t last, uint32_t begin, uint32_t end, std::vector<size_t> &changed) {
+			for (size_t index = first; index <= last; index++) {
+				uint32_t from = std::max(sectorMap.sectorBegin(index), begin), to = std::min(sectorMap.sectorEnd(index), end);
+
+				auto checksum = deviceChecksum(from, to);
+				if (checksum == nullptr) return false;
+				if (*checksum != computeFlashChecksum(image + from, to - from)) changed.push_back(index);
+
+				report(Stage::COMPARE, to - begin, end - begin);
+			}
+			return true;
+		}
+
+		bool FlashProgrammer::verifyRange(const uint8_t *image, uint32_t begin, uint32_t end) {
+			auto verifyBegin = Clock::now();
+
+			auto checksum = deviceChecksum(begin, end);
+			stats.verifyTime += seconds(Clock::now() - verifyBegin);
+			report(Stage::VERIFY, end - begin, end - begin);
+
+			return (checksum != nullptr && *checksum == computeFlashChecksum(image + begin, end - begin));
+		}
+
+		bool FlashProgrammer::program(const uint8_t *image, size_t size, uint32_t offset, bool verify) {
+			started = Clock::now();
+			stats = Statistics();
+
+			if (size <= offset || size > sectorMap.size) return false;
+
+			auto range = sectorMap.sectorsIn(offset, static_cast<uint32_t>(size));
+			if (range.first == range.second || sectorMap.sectorBegin(range.first) != offset) return false;
+
+			std::vector<size_t> indices;
+			for (size_t i = range.first; i < range.second; i++) indices.push_back(i);
+
+			if (!setFlashType(flashType)) return false;
+			if (!eraseSectors(indices)) return false;
+			if (!uploadSectors(image, indices, offset, static_cast<uint32_t>(size))) return false;
+			if (verify && !verifyRange(image, offset, static_cast<uint32_t>(size))) return false;
+
+			return true;
+		}
+
+		bool FlashProgrammer::updateSectors(const uint8_t *image, const std::vector<size_t> &changed, uint32_t begin, uint32_t end, bool verify) {
+			stats.changedSectors = changed.size();
+			stats.compareTime = seconds(Clock::now() - started);
+
+			if (changed.empty()) return true;
+
+			if (!eraseSectors(changed)) return false;
+			if (!uploadSectors(image, changed, begin, end)) return false;
+
+			if (verify) {
+				for (auto index : changed) {
+					if (!verifyRange(image, std::max(sectorMap.sectorBegin(index), begin), std::min(sectorMap.sectorEnd(index), end))) return false;
+				}
+			}
+
+			return true;
+		}
+
+		bool FlashProgrammer::update(const uint8_t *image, size_t size, const uint8_t *previous, size_t previousSize, uint32_t offset, bool verify) {
+			started = Clock::now();
+			stats = Statistics();
+
+			if (size <= offset || size > sectorMap.size) return false;
+
+			auto range = sectorMap.sectorsIn(offset, static_cast<uint32_t>(size));
+			if (range.first == range.second || sectorMap.sectorBegin(range.first) != offset) return false;
+
+			if (!setFlashType(flashType)) return false;
+
+			std::vector<size_t> changed;
+			for (size_t index = range.first; index < range.second; index++) {
+				uint32_t from = sectorMap.sectorBegin(index), to = std::min(sectorMap.sectorEnd(index), static_cast<uint32_t>(size));
+				if (previous == nullptr || to > previousSize || memcmp(image + from, previous + from, to - from) != 0) changed.push_back(index);
+				report(Stage::COMPARE, to - offset, size - offset);
+			}
+
+			return updateSectors(image, changed, offset, static_cast<uint32_t>(size), verify);
+		}
+
+		bool FlashProgrammer::updateByChecksum(const uint8_t *image, size_t size, uint32_t offset, bool verify) {
+			started = Clock::now();
+			stats = Statistics();
+
+			if (size <= offset || size > sectorMap.size) return false;
+
+			auto range = sectorMap.sectorsIn(offset, static_cast<uint32_t>(size));
+			if (range.first == range.second || sectorMap.sectorBegin(range.first) != offset) return false;
+
+			if (!setFlashType(flashType)) return false;
+
+			std::vector<size_t> changed;
+			if (!compareSectors(image, range.first, range.second - 1, offset, static_cast<uint32_t>(size), changed)) return false;
+
+			return updateSectors(image, changed, offset, static_cast<uint32_t>(size), verify);
+		}
+	};
+};
@@ -0,0 +1,135 @@
+#ifndef _LC4500_FLASH_H_
+#define _LC4500_FLASH_H_
+
+#include "Transaction.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <utility>
+#include <chrono>
+#include <functional>
+#include <cassert>
+
+namespace LC4500 {
+	namespace DLPC350 {
+		constexpr uint32_t bootloaderSize = 0x20000;   // first 128KB of flash hold the bootloader
+		constexpr size_t maxFlashUploadSize = 502;     // 512 byte message - 4 header - 2 command - 4 (bootloader workaround)
+		constexpr uint8_t bootloaderFlashBusy = 0x08;  // BIT3 of the bootloader status
+
+		/*
+		* Bootloader commands. These work only in programming mode.
+		*/
+		extern bool enterProgrammingMode();
+		extern bool exitProgrammingMode();
+		extern std::unique_ptr<uint16_t> getFlashManufacturerID();
+		extern std::unique_ptr<uint64_t> getFlashDeviceID();
+		extern std::unique_ptr<uint8_t> getBootloaderStatus();
+		extern bool setFlashType(uint8_t type);
+		extern bool setFlashAddress(uint32_t address);
+		extern bool eraseFlashSector();
+		extern bool setFlashUploadSize(uint32_t size);
+		extern bool uploadFlashData(const uint8_t *data, size_t size); // size <= maxFlashUploadSize, no ACK
+		extern bool calculateFlashChecksum();
+		extern std::unique_ptr<uint32_t> getFlashChecksum();
+
+		// polls the busy bit, sleeping 50us doubling up to 10ms between polls
+		extern bool waitForFlashReady(std::chrono::milliseconds timeout = std::chrono::milliseconds(10000));
+
+		// byte sum, as computed by calculateFlashChecksum over [address, address + size)
+		extern uint32_t computeFlashChecksum(const uint8_t *data, size_t size);
+
+		/**
+		* FlashSectorMap
+		* Sector start offsets (ascending, first is 0) and total size of a flash part.
+		*/
+		struct FlashSectorMap {
+			std::vector<uint32_t> sectors;
+			uint32_t size;
+			FlashSectorMap() : size{ 0 } {}
+			FlashSectorMap(const std::vector<uint32_t> &_sectors, uint32_t _size) : sectors(_sectors), size(_size) {}
+
+			inline size_t numSectors() const { return sectors.size(); }
+			inline uint32_t sectorBegin(size_t index) const { return sectors[index]; }
+			inline uint32_t sectorEnd(size_t index) const { return (index + 1 < sectors.size()) ? sectors[index + 1] : size; }
+
+			// index of the sector containing `address`, numSectors() if out of range
+			size_t sectorOf(uint32_t address) const;
+
+			// sectors [first, second) overlapping the address range [begin, end)
+			std::pair<size_t, size_t> sectorsIn(uint32_t begin, uint32_t end) const;
+		};
+
+		/**
+		* FlashProgrammer
+		* Erases the sectors covered by an image and streams it into flash without waiting for
+		* per-chunk replies, skipping sectors whose data is entirely erased (0xFF).
+		* The device must already be in programming mode.
+		*/
+		class FlashProgrammer {
+		public:
+			enum class Stage : uint8_t { COMPARE, ERASE, PROGRAM, VERIFY };
+
+			struct Progress {
+				Stage stage;
+				size_t done;       // sectors for ERASE, bytes for COMPARE / PROGRAM / VERIFY
+				size_t total;
+				double elapsed;    // seconds since program() started
+				double throughput; // MB/s of uploaded data
+			};
+
+			struct Statistics {
+				size_t changedSectors; // sectors found to differ (update / updateByChecksum only)
+				size_t erasedSectors;
+				size_t skippedSectors; // erased but not uploaded (all 0xFF)
+				size_t uploadedBytes;
+				double compareTime;    // seconds
+				double eraseTime;      // seconds
+				double programTime;    // seconds
+				double verifyTime;     // seconds
+				double throughput;     // MB/s of uploaded data during programTime
+				Statistics() : changedSectors{ 0 }, erasedSectors{ 0 }, skippedSectors{ 0 }, uploadedBytes{ 0 }, compareTime{ 0 }, eraseTime{ 0 }, programTime{ 0 }, verifyTime{ 0 }, throughput{ 0 } {}
+			};
+
+			using ProgressCallback = std::function<void(const Progress&)>;
+
+			FlashProgrammer(const FlashSectorMap &_sectorMap, uint8_t _flashType) : sectorMap(_sectorMap), flashType(_flashType) {}
+
+			inline void setProgressCallback(const ProgressCallback &callback) { progressCallback = callback; }
+
+			// programs `image[offset, size)` to flash offset `offset`; offset must be a sector start
+			bool program(const uint8_t *image, size_t size, uint32_t offset = bootloaderSize, bool verify = true);
+
+			// same as program(), but erases and programs only the sectors where `image` differs from
+			// `previous`, the host copy of what the device was last programmed with. Sectors past
+			// previousSize count as changed. The device is not read back before the update.
+			bool update(const uint8_t *image, size_t size, const uint8_t *previous, size_t previousSize, uint32_t offset = bootloaderSize, bool verify = true);
+
+			// opt-in update when no host copy exists: a sector is skipped when its device checksum
+			// matches the image. The bootloader checksum is a byte sum, so a sector whose bytes were
+			// reordered, or whose changes add up to the same sum, is skipped and left stale.
+			bool updateByChecksum(const uint8_t *image, size_t size, uint32_t offset = bootloaderSize, bool verify = true);
+
+			inline const Statistics& statistics() const { return stats; }
+
+		private:
+			using Clock = std::chrono::steady_clock;
+
+			std::unique_ptr<uint32_t> deviceChecksum(uint32_t begin, uint32_t end);
+			bool compareSectors(const uint8_t *image, size_t first, size_t last, uint32_t begin, uint32_t end, std::vector<size_t> &changed);
+			bool updateSectors(const uint8_t *image, const std::vector<size_t> &changed, uint32_t begin, uint32_t end, bool verify);
+			bool eraseSectors(const std::vector<size_t> &indices);
+			bool uploadSectors(const uint8_t *image, const std::vector<size_t> &indices, uint32_t begin, uint32_t end);
+			bool verifyRange(const uint8_t *image, uint32_t begin, uint32_t end);
+			void report(Stage stage, size_t done, size_t total);
+
+			FlashSectorMap sectorMap;
+			uint8_t flashType;
+			ProgressCallback progressCallback;
+			Statistics stats;
+			Clock::time_point started;
+		};
+	};
+};
+
+#endif
@@ -0,0 +1,132 @@
+#include "FlashDevice.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <tuple>
+
+namespace LC4500 {
+	namespace DLPC350 {
+		namespace {
+			inline std::string trim(const std::string &str) {
+				auto begin = str.find_first_not_of(" \t\r\n");
+				if (begin == std::string::npos) return "";
+				return str.substr(begin, str.find_last_not_of(" \t\r\n") - begin + 1);
+			}
+
+			inline bool toNumber(const std::string &str, uint64_t &value) {
+				if (str.empty()) return false;
+				try {
+					size_t pos;
+					value = std::stoull(str, &pos, 0);
+					return (pos == str.size());
+				}
+				catch (...) {
+					return false;
+				}
+			}
+		};
+
+		void FlashDeviceDatabase::reindex() {
+			shortIndex.clear();
+			longIndex.clear();
+
+			for (size_t i = 0; i < devices.size(); i++) {
+				shortIndex.push_back(i);
+				if (devices[i].longDeviceID != 0) longIndex.push_back(i);
+			}
+
+			std::sort(shortIndex.begin(), shortIndex.end(), [&](size_t a, size_t b) {
+				return std::tie(devices[a].manufacturerID, devices[a].deviceID) < std::tie(devices[b].manufacturerID, devices[b].deviceID);
+			});
+			std::sort(longIndex.begin(), longIndex.end(), [&](size_t a, size_t b) {
+				return std::tie(devices[a].manufacturerID, devices[a].longDeviceID) < std::tie(devices[b].manufacturerID, devices[b].longDeviceID);
+			});
+		}
+
+		void FlashDeviceDatabase::insert(const FlashDevice &device) {
+			auto it = std::find_if(devices.begin(), devices.end(), [&](const FlashDevice &other) {
+				return other.manufacturerID == device.manufacturerID && other.deviceID == device.deviceID && other.longDeviceID == device.longDeviceID;
+			});
+
+			if (it != devices.end()) *it = device;
+			else devices.push_back(device);
+		}
+
+		void FlashDeviceDatabase::add(const FlashDevice &device) {
+			insert(device);
+			reindex();
+		}
+
+		bool FlashDeviceDatabase::load(const std::string &path) {
+			std::ifstream in(path);
+			if (!in) return false;
+
+			std::vector<FlashDevice> loaded;
+			for (std::string line; std::getline(in, line);) {
+				line = trim(line);
+				if (line.empty() || line[0] == '/' || line[0] == '#') continue;
+
+				std::vector<std::string> fields;
+				std::istringstream stream(line);
+				for (std::string field; std::getline(stream, field, ',');) fields.push_back(trim(field));
+
+				uint64_t value;
+				bool longIDs = (fields.size() > 2 && toNumber(fields[2], value));
+				size_t column = 0;
+
+				FlashDevice device;
+				uint64_t manufacturerID, longManufacturerID = 0, deviceID, longDeviceID = 0, sizeMBit, type, numSectors;
+
+				if (fields.size() < (longIDs ? 9u : 7u)) return false;
+				device.manufacturer = fields[column++];
+				if (!toNumber(fields[column++], manufacturerID)) return false;
+				if (longIDs && !toNumber(fields[column++], longManufacturerID)) return false;
+				device.name = fields[column++];
+				if (!toNumber(fields[column++], deviceID)) return false;
+				if (longIDs && !toNumber(fields[column++], longDeviceID)) return false;
+				if (!toNumber(fields[column++], sizeMBit) || !toNumber(fields[column++], type) || !toNumber(fields[column++], numSectors)) return false;
+				if (numSectors == 0 || fields.size() < column + numSectors) return false;
+
+				device.manufacturerID = static_cast<uint16_t>(manufacturerID);
+				device.longManufacturerID = longManufacturerID;
+				device.deviceID = static_cast<uint16_t>(deviceID);
+				device.longDeviceID = longDeviceID;
+				device.sizeMBit = static_cast<uint32_t>(sizeMBit);
+				device.type = static_cast<uint8_t>(type);
+				device.sectorMap.size = static_cast<uint32_t>(sizeMBit * 1024 * 1024 / 8);
+
+				for (size_t i = 0; i < numSectors; i++) {
+					uint64_t address;
+					if (!toNumber(fields[column + i], address)) return false;
+					if (device.sectorMap.sectors.empty() ? address != 0 : address <= device.sectorMap.sectors.back()) return false;
+					device.sectorMap.sectors.push_back(static_cast<uint32_t>(address));
+				}
+
+				loaded.push_back(device);
+			}
+
+			if (loaded.empty()) return false;
+
+			for (auto &device : loaded) insert(device);
+
+			reindex();
+			return true;
+		}
+
+		const FlashDevice* FlashDeviceDatabase::find(uint16_t manufacturerID, uint64_t deviceID) const {
+			auto longIt = std::lower_bound(longIndex.begin(), longIndex.end(), std::make_pair(manufacturerID, deviceID), [&](size_t index, const std::pair<uint16_t, uint64_t> &key) {
+				return std::tie(devices[index].manufacturerID, devices[index].longDeviceID) < std::tie(key.first, key.second);
+			});
+			if (longIt != longIndex.end() && devices[*longIt].manufacturerID == manufacturerID && devices[*longIt].longDeviceID == deviceID) return &devices[*longIt];
+
+			uint16_t shortID = static_cast<uint16_t>(deviceID);
+			auto shortIt = std::lower_bound(shortIndex.begin(), shortIndex.end(), std::make_pair(manufacturerID, shortID), [&](size_t index, const std::pair<uint16_t, uint16_t> &key) {
+				return std::tie(devices[index].manufacturerID, devices[index].deviceID) < std::tie(key.first, key.second);
+			});
+			if (shortIt != shortIndex.end() && devices[*shortIt].manufacturerID == manufacturerID && devices[*shortIt].deviceID == shortID) return &devices[*shortIt];
+
+			return nullptr;
+		}
+	};
+};
@@ -0,0 +1,112 @@
+#ifndef _LC4500_FLASHDEVICE_H_
+#define _LC4500_FLASHDEVICE_H_
+
+#include "Flash.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <initializer_list>
+
+namespace LC4500 {
+	namespace DLPC350 {
+		// `numSectors` consecutive sectors of `sectorSize` bytes
+		struct FlashRegion {
+			uint32_t sectorSize;
+			uint32_t numSectors;
+			constexpr FlashRegion(uint32_t _sectorSize, uint32_t _numSectors) : sectorSize(_sectorSize), numSectors(_numSectors) {}
+		};
+
+		// sectors of a flash part described by its regions, e.g. { { 0x2000, 8 }, { 0x10000, 127 } }
+		template<size_t N>
+		struct FlashLayout {
+			FlashRegion regions[N];
+
+			constexpr uint32_t numSectors() const {
+				return numSectors(0);
+			}
+
+			constexpr uint32_t size() const {
+				return size(0);
+			}
+
+			FlashSectorMap sectorMap() const {
+				FlashSectorMap map;
+				uint32_t address = 0;
+				for (auto &region : regions) {
+					for (uint32_t i = 0; i < region.numSectors; i++, address += region.sectorSize) map.sectors.push_back(address);
+				}
+				map.size = address;
+				return map;
+			}
+
+		private:
+			constexpr uint32_t numSectors(size_t i) const { return (i < N) ? regions[i].numSectors + numSectors(i + 1) : 0; }
+			constexpr uint32_t size(size_t i) const { return (i < N) ? regions[i].sectorSize * regions[i].numSectors + size(i + 1) : 0; }
+		};
+
+		struct FlashDevice {
+			std::string manufacturer;
+			uint16_t manufacturerID;
+			uint64_t longManufacturerID;
+			std::string name;
+			uint16_t deviceID;
+			uint64_t longDeviceID;
+			uint32_t sizeMBit;
+			uint8_t type; // programming algorithm passed to setFlashType
+			FlashSectorMap sectorMap;
+			FlashDevice() : manufacturerID{ 0 }, longManufacturerID{ 0 }, deviceID{ 0 }, longDeviceID{ 0 }, sizeMBit{ 0 }, type{ 0 } {}
+		};
+
+		/**
+		* FlashDeviceDatabase
+		* Flash parts keyed by the IDs read with getFlashManufacturerID / getFlashDeviceID.
+		* Parts come from the FlashDeviceParameters.txt shipped with the TI GUI, or from
+		* compile-time FlashLayout tables. Lookups are binary searches over sorted indices.
+		*/
+		class FlashDeviceDatabase {
+		public:
+			FlashDeviceDatabase() {}
+
+			// replaces an entry with the same IDs
+			void add(const FlashDevice &device);
+
+			template<size_t N>
+			void add(const std::string &manufacturer, uint16_t manufacturerID, const std::string &name, uint16_t deviceID,
+				uint8_t type, const FlashLayout<N> &layout) {
+				FlashDevice device;
+				device.manufacturer = manufacturer;
+				device.manufacturerID = manufacturerID;
+				device.name = name;
+				device.deviceID = deviceID;
+				device.sizeMBit = layout.size() / (1024 * 1024 / 8);
+				device.type = type;
+				device.sectorMap = layout.sectorMap();
+				add(device);
+			}
+
+			/*
+			* FlashDeviceParameters.txt: one part per line, '/' or '#' lines are comments
+			*   Mfg, Mfg_ID, [LMfg_ID,] Dev, Dev_ID, [LDev_ID,] Size_MBit, Type, numSectors, sector addresses...
+			* the long IDs are present when the third column is numeric; sector addresses ascend from 0.
+			*/
+			bool load(const std::string &path);
+
+			// matches the long device ID first, then the 16-bit device ID
+			const FlashDevice* find(uint16_t manufacturerID, uint64_t deviceID) const;
+
+			inline size_t size() const { return devices.size(); }
+			inline const std::vector<FlashDevice>& getDevices() const { return devices; }
+
+		private:
+			void insert(const FlashDevice &device);
+			void reindex();
+
+			std::vector<FlashDevice> devices;
+			std::vector<size_t> shortIndex; // sorted by (manufacturerID, deviceID)
+			std::vector<size_t> longIndex;  // sorted by (manufacturerID, longDeviceID), parts with a long ID only
+		};
+	};
+};
+
+#endif
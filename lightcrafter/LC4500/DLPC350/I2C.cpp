@@ -0,0 +1,170 @@
+#include "I2C.hpp"
+
+#include <cstring>
+
+namespace LC4500 {
+	namespace DLPC350 {
+		namespace {
+			constexpr size_t headerSize = 4; // flags, sequence, length
+
+			inline std::vector<uint8_t> registerPrefix(uint32_t registerAddress, size_t addressBytes) {
+				std::vector<uint8_t> prefix(addressBytes);
+				for (size_t i = 0; i < addressBytes; i++) prefix[i] = static_cast<uint8_t>(registerAddress >> (8 * (addressBytes - i - 1)));
+				return prefix;
+			}
+
+			struct Chunk {
+				Transaction transaction;
+				size_t readSize;
+			};
+
+			/**
+			* makeWrite
+			* CMD2 : 0x1A, CMD3 : 0x3B, Param : 13 + size
+			*/
+			Transaction makeWrite(uint16_t deviceAddress, uint32_t clock, I2CAddressMode addressMode, const uint8_t *data, size_t size) {
+				auto tran = Transaction(Transaction::Type::WRITE, 0x1A3B, static_cast<uint8_t>(addressMode), static_cast<uint32_t>(clock),
+					static_cast<uint32_t>(0), static_cast<uint16_t>(deviceAddress), static_cast<uint16_t>(size));
+				memcpy(&tran.data[tran.length], data, size);
+				tran.length += static_cast<uint16_t>(size);
+				return tran;
+			}
+
+			/**
+			* makeRead
+			* CMD2 : 0x1A, CMD3 : 0x3B, Param : 15 + prefixSize
+			*/
+			Transaction makeRead(uint16_t deviceAddress, uint32_t clock, I2CAddressMode addressMode, const uint8_t *prefix, size_t prefixSize, size_t size) {
+				auto tran = Transaction(Transaction::Type::READ, 0x1A3B, static_cast<uint8_t>(addressMode), static_cast<uint32_t>(clock),
+					static_cast<uint32_t>(0), static_cast<uint16_t>(deviceAddress), static_cast<uint16_t>(prefixSize), static_cast<uint16_t>(size));
+				if (prefixSize > 0) memcpy(&tran.data[tran.length], prefix, prefixSize);
+				tran.length += static_cast<uint16_t>(prefixSize);
+				return tran;
+			}
+
+			/**
+			* run
+			* Sends the chunks with up to `depth` in flight. Read replies longer than one packet
+			* continue in raw packets, which are drained before the next reply is matched.
+			* After a failure the replies still in flight are received before returning.
+			* `status` is set to I2C0_STAT when all chunks went through.
+			*/
+			bool run(std::vector<Chunk> &chunks, size_t depth, uint8_t *out, I2CStatus &status) {
+				std::unique_ptr<Transaction> pending;
+				size_t sent = 0, received = 0;
+				bool ok = true;
+
+				while (true) {
+					while (ok && sent < chunks.size() && sent - received < depth) {
+						chunks[sent].transaction.sequence = nextSequence();
+						if (LC4500::write(chunks[sent].transaction) <= 0) {
+							ok = false;
+							break;
+						}
+						sent++;
+					}
+					if (received == sent) break;
+
+					size_t readSize = chunks[received].readSize;
+					auto reply = receive(chunks[received].transaction.sequence, pending);
+					received++;
+
+					if (reply == nullptr) {
+						ok = false;
+						continue;
+					}
+
+					if (readSize > 0) {
+						size_t copied = std::min(readSize, USB::maxPacketSize - headerSize);
+						memcpy(out, reply.get(), copied);
+
+						while (copied < readSize) {
+							auto packet = USB::read();
+							if (packet == nullptr) return false;
+
+							size_t num = std::min(readSize - copied, USB::maxPacketSize);
+							memcpy(out + copied, packet.get(), num);
+							copied += num;
+						}
+
+						out += readSize;
+					}
+				}
+				if (!ok) return false;
+
+				auto result = getI2CStatus();
+				if (result == nullptr) return false;
+
+				status = *result;
+				return (status == I2CStatus::SUCCESS);
+			}
+		};
+
+		/**
+		* getI2CStatus
+		* CMD2 : 0x1A, CMD3 : 0x43
+		*/
+		std::unique_ptr<I2CStatus> getI2CStatus() {
+			auto result = transactForGetValues(0x1A43);
+			if (result == nullptr) return nullptr;
+			return std::unique_ptr<I2CStatus>(new I2CStatus(static_cast<I2CStatus>(*result.get())));
+		}
+
+		bool I2CChannel::write(const uint8_t *data, size_t size) {
+			std::vector<Chunk> chunks;
+			for (size_t offset = 0; offset < size; offset += chunkSize) {
+				chunks.push_back(Chunk{ makeWrite(deviceAddress, clock, addressMode, data + offset, std::min(size - offset, chunkSize)), 0 });
+			}
+			return run(chunks, depth, nullptr, status);
+		}
+
+		std::unique_ptr<std::vector<uint8_t>> I2CChannel::read(size_t size, const std::vector<uint8_t> &prefix) {
+			if (prefix.size() > chunkSize) return nullptr;
+
+			std::vector<Chunk> chunks;
+			for (size_t offset = 0; offset < size; offset += chunkSize) {
+				size_t num = std::min(size - offset, chunkSize);
+				if (offset == 0) chunks.push_back(Chunk{ makeRead(deviceAddress, clock, addressMode, prefix.data(), prefix.size(), num), num });
+				else chunks.push_back(Chunk{ makeRead(deviceAddress, clock, addressMode, nullptr, 0, num), num });
+			}
+
+			std::unique_ptr<std::vector<uint8_t>> ret(new std::vector<uint8_t>(size));
+			if (!run(chunks, depth, ret->data(), status)) return nullptr;
+			return ret;
+		}
+
+		bool I2CChannel::writeRegisters(uint32_t registerAddress, size_t addressBytes, const std::vector<uint8_t> &data) {
+			if (addressBytes == 0 || addressBytes > 4 || addressBytes >= chunkSize) return false;
+
+			size_t dataSize = chunkSize - addressBytes;
+			std::vector<uint8_t> buffer(chunkSize);
+			std::vector<Chunk> chunks;
+
+			for (size_t offset = 0; offset < data.size(); offset += dataSize) {
+				size_t num = std::min(data.size() - offset, dataSize);
+				auto prefix = registerPrefix(registerAddress + static_cast<uint32_t>(offset), addressBytes);
+
+				std::copy(prefix.begin(), prefix.end(), buffer.begin());
+				std::copy(data.begin() + offset, data.begin() + offset + num, buffer.begin() + addressBytes);
+				chunks.push_back(Chunk{ makeWrite(deviceAddress, clock, addressMode, buffer.data(), addressBytes + num), 0 });
+			}
+
+			return run(chunks, depth, nullptr, status);
+		}
+
+		std::unique_ptr<std::vector<uint8_t>> I2CChannel::readRegisters(uint32_t registerAddress, size_t addressBytes, size_t size) {
+			if (addressBytes == 0 || addressBytes > 4) return nullptr;
+
+			std::vector<Chunk> chunks;
+			for (size_t offset = 0; offset < size; offset += chunkSize) {
+				size_t num = std::min(size - offset, chunkSize);
+				auto prefix = registerPrefix(registerAddress + static_cast<uint32_t>(offset), addressBytes);
+				chunks.push_back(Chunk{ makeRead(deviceAddress, clock, addressMode, prefix.data(), prefix.size(), num), num });
+			}
+
+			std::unique_ptr<std::vector<uint8_t>> ret(new std::vector<uint8_t>(size));
+			if (!run(chunks, depth, ret->data(), status)) return nullptr;
+			return ret;
+		}
+	};
+};
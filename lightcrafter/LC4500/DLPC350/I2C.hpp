@@ -0,0 +1,73 @@
+#ifndef _LC4500_I2C_H_
+#define _LC4500_I2C_H_
+
+#include "Transaction.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <cassert>
+
+namespace LC4500 {
+	namespace DLPC350 {
+		enum class I2CAddressMode : uint8_t {
+			BITS7 = 0,
+			BITS10 = 1
+		};
+
+		// I2C0_STAT bits, several can be set at once
+		enum class I2CStatus : uint8_t {
+			SUCCESS = 0x00,
+			NO_ACK = 0x01,
+			ARBITRATION_LOST = 0x02,
+			WRITE_TIMEOUT = 0x04,
+			READ_TIMEOUT = 0x08,
+			INTERNAL_ERROR = 0x20
+		};
+
+		constexpr size_t maxI2CPayloadSize = 495; // 512 byte message - 2 command bytes - 15 byte read preamble
+
+		extern std::unique_ptr<I2CStatus> getI2CStatus();
+
+		/**
+		* I2CChannel
+		* Master transfers to one slave on the I2C0 port, of any length.
+		* Transfers are split into I2C0_CTRL transactions of at most `chunkSize` bytes, up to `depth`
+		* of them are kept in flight, and I2C0_STAT is read once after the whole batch.
+		* Every chunk is a separate bus transaction; use the register variants for devices that
+		* need the register address in front of every transaction.
+		*/
+		class I2CChannel {
+		public:
+			I2CChannel(uint16_t _deviceAddress, uint32_t _clock = 100000, I2CAddressMode _addressMode = I2CAddressMode::BITS7,
+				size_t _chunkSize = maxI2CPayloadSize, size_t _depth = 8) :
+				deviceAddress(_deviceAddress), clock(_clock), addressMode(_addressMode),
+				chunkSize(std::max<size_t>(std::min(_chunkSize, maxI2CPayloadSize), 1)), depth(std::max<size_t>(_depth, 1)), status(I2CStatus::SUCCESS) {
+				assert(18194 <= clock && clock <= 400000);
+			}
+
+			bool write(const uint8_t *data, size_t size);
+			bool write(const std::vector<uint8_t> &data) { return write(data.data(), data.size()); }
+
+			// optional `prefix` is written (repeated start) before the first chunk only
+			std::unique_ptr<std::vector<uint8_t>> read(size_t size, const std::vector<uint8_t> &prefix = std::vector<uint8_t>());
+
+			// `registerAddress` is sent MSB first in `addressBytes` bytes and advanced by the chunk offset
+			bool writeRegisters(uint32_t registerAddress, size_t addressBytes, const std::vector<uint8_t> &data);
+			std::unique_ptr<std::vector<uint8_t>> readRegisters(uint32_t registerAddress, size_t addressBytes, size_t size);
+
+			// I2C0_STAT of the last batch
+			inline I2CStatus lastStatus() const { return status; }
+
+		private:
+			uint16_t deviceAddress;
+			uint32_t clock;
+			I2CAddressMode addressMode;
+			size_t chunkSize;
+			size_t depth;
+			I2CStatus status;
+		};
+	};
+};
+
+#endif
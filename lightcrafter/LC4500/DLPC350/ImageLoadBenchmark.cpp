@@ -0,0 +1,146 @@
+#include "ImageLoadBenchmark.hpp"
+
+#include <cmath>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+namespace LC4500 {
+	namespace DLPC350 {
+		/**
+		* measureImageLoadTiming
+		* CMD2 : 0x1A, CMD3 : 0x3A, Param : 2
+		*/
+		bool measureImageLoadTiming(uint8_t startIndex, uint8_t numImages) {
+			auto result = transactForSetValues<uint8_t, uint8_t>(0x1A3A, std::forward<uint8_t>(startIndex), std::forward<uint8_t>(numImages));
+			return (result != nullptr);
+		}
+
+		/**
+		* getImageLoadTiming
+		* CMD2 : 0x1A, CMD3 : 0x3A
+		*/
+		std::unique_ptr<uint32_t> getImageLoadTiming() {
+			auto result = transactForGetValues<uint32_t>(0x1A3A);
+			if (result == nullptr) return nullptr;
+			return std::unique_ptr<uint32_t>(new uint32_t(*result.get()));
+		}
+
+		bool ImageLoadBenchmark::run(size_t repeats) {
+			auto tag = getFirmwareTag();
+			auto numImages = getNumImagesInFlash();
+			if (!tag || !numImages) return false;
+
+			_firmwareTag = *tag;
+			_results.clear();
+			repeats = std::max<size_t>(repeats, 1);
+
+			for (uint8_t index = 0; index < *numImages; index++) {
+				Result result;
+				result.imageIndex = index;
+
+				double sum = 0, sumSquare = 0;
+				for (size_t i = 0; i < repeats; i++) {
+					if (!measureImageLoadTiming(index)) return false;
+					auto timing = getImageLoadTiming();
+					if (!timing) return false;
+
+					double time = *timing / imageLoadTimingClock;
+					result.min = (result.samples == 0) ? time : std::min(result.min, time);
+					result.max = (result.samples == 0) ? time : std::max(result.max, time);
+					sum += time;
+					sumSquare += time * time;
+					result.samples++;
+				}
+
+				result.mean = sum / result.samples;
+				result.stdDev = std::sqrt(std::max(0.0, sumSquare / result.samples - result.mean * result.mean));
+				_results.push_back(result);
+			}
+
+			return true;
+		}
+
+		/**
+		* save
+		* One CSV row per image: tag,index,samples,mean,min,max,stddev (microseconds).
+		* Rows of other firmware tags already in the file are kept; rows of this tag are replaced.
+		*/
+		bool ImageLoadBenchmark::save(const std::string &path) const {
+			std::vector<std::string> lines;
+			std::string prefix = _firmwareTag + ",";
+
+			std::ifstream in(path);
+			for (std::string line; std::getline(in, line);) {
+				if (!line.empty() && line.compare(0, prefix.size(), prefix) != 0) lines.push_back(line);
+			}
+			in.close();
+
+			std::ofstream out(path, std::ios::trunc);
+			if (!out) return false;
+
+			for (auto &line : lines) out << line << "\n";
+			for (auto &result : _results) {
+				out << _firmwareTag << "," << static_cast<int>(result.imageIndex) << "," << result.samples << ","
+					<< result.mean << "," << result.min << "," << result.max << "," << result.stdDev << "\n";
+			}
+
+			return static_cast<bool>(out);
+		}
+
+		bool ImageLoadBenchmark::load(const std::string &path, const std::string &firmwareTag) {
+			std::ifstream in(path);
+			if (!in) return false;
+
+			std::string prefix = firmwareTag + ",";
+			std::vector<Result> results;
+
+			for (std::string line; std::getline(in, line);) {
+				if (line.compare(0, prefix.size(), prefix) != 0) continue;
+
+				std::istringstream fields(line.substr(prefix.size()));
+				Result result;
+				int index;
+				char comma;
+				if (fields >> index >> comma >> result.samples >> comma >> result.mean >> comma
+					>> result.min >> comma >> result.max >> comma >> result.stdDev) {
+					result.imageIndex = static_cast<uint8_t>(index);
+					results.push_back(result);
+				}
+			}
+
+			if (results.empty()) return false;
+
+			_firmwareTag = firmwareTag;
+			_results = std::move(results);
+			return true;
+		}
+
+		const ImageLoadBenchmark::Result* ImageLoadBenchmark::find(uint8_t imageIndex) const {
+			for (auto &result : _results) {
+				if (result.imageIndex == imageIndex) return &result;
+			}
+			return nullptr;
+		}
+
+		/**
+		* check
+		* Reports every buffer swap whose worst measured image load time exceeds the frame period (us).
+		*/
+		std::vector<ImageLoadBenchmark::Warning> ImageLoadBenchmark::check(PatternSequence &patternSequence, uint32_t framePeriod) const {
+			std::vector<Warning> warnings;
+
+			for (size_t i = 0; i < patternSequence.sizePattern(); i++) {
+				Pattern &pattern = patternSequence.getPattern(i);
+				if (!pattern.data.bufferSwap) continue;
+
+				const Result *result = find(pattern.imageIndex);
+				if (result == nullptr || result->max <= framePeriod) continue;
+
+				warnings.push_back(Warning{ i, pattern.imageIndex, result->max, static_cast<double>(framePeriod) });
+			}
+
+			return warnings;
+		}
+	};
+};
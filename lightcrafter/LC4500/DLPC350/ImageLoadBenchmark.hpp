@@ -0,0 +1,64 @@
+#ifndef _LC4500_IMAGELOADBENCHMARK_H_
+#define _LC4500_IMAGELOADBENCHMARK_H_
+
+#include "DLPC350.hpp"
+#include "PatternSequence.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace LC4500 {
+	namespace DLPC350 {
+		constexpr double imageLoadTimingClock = 18.667; // ticks per microsecond
+
+		extern bool measureImageLoadTiming(uint8_t startIndex, uint8_t numImages = 1);
+		extern std::unique_ptr<uint32_t> getImageLoadTiming();
+
+		/**
+		* ImageLoadBenchmark
+		* Measures the flash-to-buffer load time of every image in flash, repeated `repeats` times,
+		* and keeps per-image statistics keyed by the firmware tag they were measured on.
+		* Pattern sequence must be stopped while measuring.
+		*/
+		class ImageLoadBenchmark {
+		public:
+			struct Result {
+				uint8_t imageIndex;
+				size_t samples;
+				double mean;   // microseconds
+				double min;    // microseconds
+				double max;    // microseconds
+				double stdDev; // microseconds
+				Result() : imageIndex{ 0 }, samples{ 0 }, mean{ 0 }, min{ 0 }, max{ 0 }, stdDev{ 0 } {}
+			};
+
+			struct Warning {
+				size_t patternIndex;
+				uint8_t imageIndex;
+				double loadTime;    // microseconds (worst observed)
+				double framePeriod; // microseconds
+			};
+
+			ImageLoadBenchmark() {}
+
+			bool run(size_t repeats = 10);
+
+			bool save(const std::string &path) const;
+			bool load(const std::string &path, const std::string &firmwareTag);
+
+			inline const std::string& firmwareTag() const { return _firmwareTag; }
+			inline const std::vector<Result>& results() const { return _results; }
+			const Result* find(uint8_t imageIndex) const;
+
+			std::vector<Warning> check(PatternSequence &patternSequence, uint32_t framePeriod) const;
+
+		private:
+			std::string _firmwareTag;
+			std::vector<Result> _results;
+		};
+	};
+};
+
+#endif
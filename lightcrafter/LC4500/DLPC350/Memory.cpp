@@ -0,0 +1,223 @@
+#include "Memory.hpp"
+
+#include <map>
+#include <fstream>
+#include <sstream>
+
+namespace LC4500 {
+	namespace DLPC350 {
+		namespace {
+			constexpr size_t maxTransactionsInBatch = 256;
+			constexpr char snapshotMagic[4] = { 'L', 'C', 'R', 'S' };
+			constexpr uint16_t snapshotVersion = 1;
+
+			inline uint32_t toWord(const uint8_t *ptr) {
+				return ptr[0] | (ptr[1] << 8) | (ptr[2] << 16) | (static_cast<uint32_t>(ptr[3]) << 24);
+			}
+
+			template<typename T>
+			inline void writeLE(std::ostream &out, T value) {
+				for (size_t i = 0; i < sizeof(T); i++) out.put(static_cast<char>((value >> (8 * i)) & 0xFF));
+			}
+
+			template<typename T>
+			inline bool readLE(std::istream &in, T &value) {
+				value = 0;
+				for (size_t i = 0; i < sizeof(T); i++) {
+					int c = in.get();
+					if (c == EOF) return false;
+					value |= static_cast<T>(static_cast<uint8_t>(c)) << (8 * i);
+				}
+				return true;
+			}
+		};
+
+		/**
+		* readMemory
+		* CMD2 : 0x1A, CMD3 : 0x16, Param : 4
+		*/
+		std::unique_ptr<uint32_t> readMemory(uint32_t address) {
+			auto send = Transaction(Transaction::Type::READ, 0x1A16, std::forward<uint32_t>(address));
+			auto result = transact(send);
+			if (result == nullptr) return nullptr;
+			return std::unique_ptr<uint32_t>(new uint32_t(toWord(result.get())));
+		}
+
+		/**
+		* writeMemory
+		* CMD2 : 0x1A, CMD3 : 0x16, Param : 9
+		*/
+		bool writeMemory(uint32_t address, uint32_t data) {
+			auto result = transactForSetValues<uint8_t, uint32_t, uint32_t>(0x1A16, 0, std::forward<uint32_t>(address), std::forward<uint32_t>(data));
+			return (result != nullptr);
+		}
+
+		std::unique_ptr<std::vector<uint32_t>> readBlock(const std::vector<uint32_t> &addresses, size_t depth) {
+			std::unique_ptr<std::vector<uint32_t>> ret(new std::vector<uint32_t>());
+			ret->reserve(addresses.size());
+
+			std::vector<Transaction> requests;
+			requests.reserve(std::min(addresses.size(), maxTransactionsInBatch));
+
+			for (size_t offset = 0; offset < addresses.size(); offset += maxTransactionsInBatch) {
+				size_t num = std::min(addresses.size() - offset, maxTransactionsInBatch);
+
+				requests.clear();
+				for (size_t i = 0; i < num; i++) {
+					requests.push_back(Transaction(Transaction::Type::READ, 0x1A16, static_cast<uint32_t>(addresses[offset + i])));
+				}
+
+				auto results = transactPipelined(requests, depth);
+				for (auto &result : results) {
+					if (result == nullptr) return nullptr;
+					ret->push_back(toWord(result.get()));
+				}
+			}
+
+			return ret;
+		}
+
+		std::unique_ptr<std::vector<uint32_t>> readBlock(uint32_t address, size_t numWords, size_t depth) {
+			std::vector<uint32_t> addresses(numWords);
+			for (size_t i = 0; i < numWords; i++) addresses[i] = address + static_cast<uint32_t>(i * sizeof(uint32_t));
+			return readBlock(addresses, depth);
+		}
+
+		bool writeBlock(const std::vector<std::pair<uint32_t, uint32_t>> &words, size_t depth) {
+			std::vector<Transaction> requests;
+			requests.reserve(std::min(words.size(), maxTransactionsInBatch));
+
+			for (size_t offset = 0; offset < words.size(); offset += maxTransactionsInBatch) {
+				size_t num = std::min(words.size() - offset, maxTransactionsInBatch);
+
+				requests.clear();
+				for (size_t i = 0; i < num; i++) {
+					auto &word = words[offset + i];
+					requests.push_back(Transaction(Transaction::Type::WRITE, 0x1A16, static_cast<uint8_t>(0), static_cast<uint32_t>(word.first), static_cast<uint32_t>(word.second)));
+				}
+
+				auto results = transactPipelined(requests, depth);
+				for (auto &result : results) {
+					if (result == nullptr) return false;
+				}
+			}
+
+			return true;
+		}
+
+		bool writeBlock(uint32_t address, const std::vector<uint32_t> &data, size_t depth) {
+			std::vector<std::pair<uint32_t, uint32_t>> words(data.size());
+			for (size_t i = 0; i < data.size(); i++) words[i] = std::make_pair(address + static_cast<uint32_t>(i * sizeof(uint32_t)), data[i]);
+			return writeBlock(words, depth);
+		}
+
+		bool RegisterSnapshot::loadMap(const std::string &path) {
+			std::ifstream in(path);
+			if (!in) return false;
+
+			std::vector<Region> map;
+			for (std::string line; std::getline(in, line);) {
+				line = line.substr(0, line.find('#'));
+
+				std::istringstream fields(line);
+				std::string name;
+				uint32_t address, numWords;
+				if (!(fields >> name)) continue;
+				if (!(fields >> std::hex >> address >> std::dec >> numWords) || numWords == 0 || name.size() > 0xFF) return false;
+
+				map.push_back(Region(name, address, numWords));
+			}
+
+			if (map.empty()) return false;
+
+			regions = std::move(map);
+			return true;
+		}
+
+		bool RegisterSnapshot::capture(size_t depth) {
+			std::vector<uint32_t> addresses;
+			for (auto &region : regions) {
+				for (uint32_t i = 0; i < region.numWords; i++) addresses.push_back(region.address + i * sizeof(uint32_t));
+			}
+
+			auto words = readBlock(addresses, depth);
+			if (words == nullptr) return false;
+
+			auto it = words->begin();
+			for (auto &region : regions) {
+				region.data.assign(it, it + region.numWords);
+				it += region.numWords;
+			}
+
+			return true;
+		}
+
+		bool RegisterSnapshot::save(const std::string &path) const {
+			std::ofstream out(path, std::ios::binary | std::ios::trunc);
+			if (!out) return false;
+
+			out.write(snapshotMagic, sizeof(snapshotMagic));
+			writeLE<uint16_t>(out, snapshotVersion);
+			writeLE<uint16_t>(out, static_cast<uint16_t>(regions.size()));
+
+			for (auto &region : regions) {
+				if (region.data.size() != region.numWords) return false;
+
+				writeLE<uint32_t>(out, region.address);
+				writeLE<uint32_t>(out, region.numWords);
+				writeLE<uint8_t>(out, static_cast<uint8_t>(region.name.size()));
+				out.write(region.name.data(), region.name.size());
+				for (auto word : region.data) writeLE<uint32_t>(out, word);
+			}
+
+			return static_cast<bool>(out);
+		}
+
+		bool RegisterSnapshot::load(const std::string &path) {
+			std::ifstream in(path, std::ios::binary);
+			if (!in) return false;
+
+			char magic[sizeof(snapshotMagic)];
+			uint16_t version, numRegions;
+			if (!in.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), snapshotMagic)) return false;
+			if (!readLE(in, version) || version != snapshotVersion || !readLE(in, numRegions)) return false;
+
+			std::vector<Region> loaded(numRegions);
+			for (auto &region : loaded) {
+				uint8_t nameLength;
+				if (!readLE(in, region.address) || !readLE(in, region.numWords) || !readLE(in, nameLength)) return false;
+
+				region.name.resize(nameLength);
+				if (nameLength > 0 && !in.read(&region.name[0], nameLength)) return false;
+
+				region.data.resize(region.numWords);
+				for (auto &word : region.data) {
+					if (!readLE(in, word)) return false;
+				}
+			}
+
+			regions = std::move(loaded);
+			return true;
+		}
+
+		std::vector<RegisterSnapshot::Difference> RegisterSnapshot::diff(const RegisterSnapshot &before, const RegisterSnapshot &after) {
+			std::map<uint32_t, uint32_t> words;
+			for (auto &region : before.regions) {
+				for (size_t i = 0; i < region.data.size(); i++) words[region.address + static_cast<uint32_t>(i * sizeof(uint32_t))] = region.data[i];
+			}
+
+			std::vector<Difference> differences;
+			for (auto &region : after.regions) {
+				for (size_t i = 0; i < region.data.size(); i++) {
+					uint32_t address = region.address + static_cast<uint32_t>(i * sizeof(uint32_t));
+					auto it = words.find(address);
+					if (it == words.end() || it->second == region.data[i]) continue;
+
+					differences.push_back(Difference{ region.name, address, it->second, region.data[i] });
+				}
+			}
+
+			return differences;
+		}
+	};
+};
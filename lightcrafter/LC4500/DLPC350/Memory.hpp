@@ -0,0 +1,74 @@
+#ifndef _LC4500_MEMORY_H_
+#define _LC4500_MEMORY_H_
+
+#include "Transaction.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <utility>
+
+namespace LC4500 {
+	namespace DLPC350 {
+		constexpr size_t defaultMemoryPipelineDepth = 16;
+
+		extern std::unique_ptr<uint32_t> readMemory(uint32_t address);
+		extern bool writeMemory(uint32_t address, uint32_t data);
+
+		// Word reads/writes with up to `depth` MEM_CONTROL transactions in flight.
+		extern std::unique_ptr<std::vector<uint32_t>> readBlock(const std::vector<uint32_t> &addresses, size_t depth = defaultMemoryPipelineDepth);
+		extern std::unique_ptr<std::vector<uint32_t>> readBlock(uint32_t address, size_t numWords, size_t depth = defaultMemoryPipelineDepth);
+		extern bool writeBlock(const std::vector<std::pair<uint32_t, uint32_t>> &words, size_t depth = defaultMemoryPipelineDepth);
+		extern bool writeBlock(uint32_t address, const std::vector<uint32_t> &data, size_t depth = defaultMemoryPipelineDepth);
+
+		/**
+		* RegisterSnapshot
+		* Captures the words of every region in a register map with pipelined reads,
+		* and saves/loads them as a compact little-endian binary file:
+		*   "LCRS" | version u16 | regions u16 | { address u32 | words u32 | name length u8 | name | words * u32 }
+		*/
+		class RegisterSnapshot {
+		public:
+			struct Region {
+				std::string name;
+				uint32_t address; // first word address
+				uint32_t numWords;
+				std::vector<uint32_t> data;
+				Region() : address{ 0 }, numWords{ 0 } {}
+				Region(const std::string &_name, uint32_t _address, uint32_t _numWords) : name(_name), address(_address), numWords(_numWords) {}
+			};
+
+			struct Difference {
+				std::string region;
+				uint32_t address;
+				uint32_t before;
+				uint32_t after;
+			};
+
+			RegisterSnapshot() {}
+
+			void addRegion(const std::string &name, uint32_t address, uint32_t numWords) {
+				regions.push_back(Region(name, address, numWords));
+			}
+
+			// register map text: one "name address numWords" per line, '#' starts a comment
+			bool loadMap(const std::string &path);
+
+			bool capture(size_t depth = defaultMemoryPipelineDepth);
+
+			bool save(const std::string &path) const;
+			bool load(const std::string &path);
+
+			inline const std::vector<Region>& getRegions() const { return regions; }
+
+			// words that differ between two snapshots; words present in only one snapshot are skipped
+			static std::vector<Difference> diff(const RegisterSnapshot &before, const RegisterSnapshot &after);
+
+		private:
+			std::vector<Region> regions;
+		};
+	};
+};
+
+#endif
@@ -0,0 +1,178 @@
+﻿#include "PWMCapture.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+namespace LC4500 {
+	namespace DLPC350 {
+		/**
+		* getPWMCaptureConfig
+		* CMD2 : 0x1A, CMD3 : 0x12, Param : 1
+		*/
+		std::unique_ptr<PWMCaptureConfig> getPWMCaptureConfig(PWMCaptureChannel channel) {
+			auto send = Transaction(Transaction::Type::READ, 0x1A12, static_cast<uint8_t>(channel));
+			auto result = transact(send);
+			if (result == nullptr) return nullptr;
+
+			uint8_t *ptr = result.get();
+			uint32_t sampleRate = ptr[1] | (ptr[2] << 8) | (ptr[3] << 16) | (static_cast<uint32_t>(ptr[4]) << 24);
+			return std::unique_ptr<PWMCaptureConfig>(new PWMCaptureConfig((ptr[0] & 0x80) != 0, sampleRate));
+		}
+
+		/**
+		* setPWMCaptureConfig
+		* CMD2 : 0x1A, CMD3 : 0x12, Param : 5
+		*/
+		bool setPWMCaptureConfig(PWMCaptureChannel channel, bool enable, uint32_t sampleRate) {
+			assert(285 <= sampleRate && sampleRate <= 18666667);
+
+			uint8_t value = static_cast<uint8_t>(channel) & 0x01;
+			if (enable) value |= 0x80;
+
+			auto result = transactForSetValues<uint8_t, uint32_t>(0x1A12, std::forward<uint8_t>(value), std::forward<uint32_t>(sampleRate));
+			return (result != nullptr);
+		}
+
+		/**
+		* readPWMCapture
+		* CMD2 : 0x1A, CMD3 : 0x13, Param : 1
+		*/
+		std::unique_ptr<PWMCapture> readPWMCapture(PWMCaptureChannel channel) {
+			auto send = Transaction(Transaction::Type::READ, 0x1A13, static_cast<uint8_t>(channel));
+			auto result = transact(send);
+			if (result == nullptr) return nullptr;
+
+			uint8_t *ptr = result.get();
+			return std::unique_ptr<PWMCapture>(new PWMCapture(ptr[1] | (ptr[2] << 8), ptr[3] | (ptr[4] << 8)));
+		}
+
+		PWMCaptureSampler::PWMCaptureSampler(PWMCaptureChannel _channel, uint32_t _sampleRate, size_t capacity, size_t _depth) :
+			channel(_channel), sampleRate(_sampleRate), depth(std::max<size_t>(_depth, 1)),
+			buffer(std::max<size_t>(capacity, 1)), head(0), count(0), running(false) {}
+
+		PWMCaptureSampler::~PWMCaptureSampler() {
+			stop();
+		}
+
+		bool PWMCaptureSampler::start() {
+			if (running) return true;
+
+			// a worker that gave up after a USB error has exited but is still joinable
+			stop();
+			if (!setPWMCaptureConfig(channel, true, sampleRate)) return false;
+
+			running = true;
+			worker = std::thread(&PWMCaptureSampler::run, this);
+			return true;
+		}
+
+		// also joins a worker that has already stopped on its own
+		void PWMCaptureSampler::stop() {
+			running = false;
+			if (worker.joinable()) {
+				worker.join();
+				setPWMCaptureConfig(channel, false, sampleRate);
+			}
+		}
+
+		void PWMCaptureSampler::run() {
+			std::vector<Transaction> requests(depth, Transaction(Transaction::Type::READ, 0x1A13, static_cast<uint8_t>(channel)));
+			std::unique_ptr<Transaction> pending;
+
+			size_t sent = 0, received = 0;
+			while (running || received < sent) {
+				while (running && sent - received < depth) {
+					requests[sent % depth].sequence = nextSequence();
+					if (write(requests[sent % depth]) <= 0) {
+						running = false;
+						break;
+					}
+					sent++;
+				}
+				if (received == sent) break;
+
+				auto result = receive(requests[received % depth].sequence, pending);
+				received++;
+
+				if (result == nullptr) {
+					running = false;
+					continue;
+				}
+
+				uint8_t *ptr = result.get();
+				Sample sample;
+				sample.time = Clock::now();
+				sample.capture = PWMCapture(ptr[1] | (ptr[2] << 8), ptr[3] | (ptr[4] << 8));
+				push(sample);
+			}
+		}
+
+		void PWMCaptureSampler::push(const Sample &sample) {
+			std::lock_guard<std::mutex> lock(mutex);
+			buffer[head] = sample;
+			head = (head + 1) % buffer.size();
+			count = std::min(count + 1, buffer.size());
+		}
+
+		std::vector<PWMCaptureSampler::Sample> PWMCaptureSampler::samples() const {
+			std::lock_guard<std::mutex> lock(mutex);
+			std::vector<Sample> ret;
+			ret.reserve(count);
+
+			size_t tail = (head + buffer.size() - count) % buffer.size();
+			for (size_t i = 0; i < count; i++) {
+				ret.push_back(buffer[(tail + i) % buffer.size()]);
+			}
+			return ret;
+		}
+
+		void PWMCaptureSampler::clear() {
+			std::lock_guard<std::mutex> lock(mutex);
+			head = 0;
+			count = 0;
+		}
+
+		PWMCaptureSampler::Statistics PWMCaptureSampler::statistics() const {
+			auto snapshot = samples();
+			Statistics ret;
+			if (snapshot.empty()) return ret;
+
+			double tick = 1.0 / sampleRate;
+			double sum = 0, sumSquare = 0, sumDuty = 0;
+			double minPeriod = 0, maxPeriod = 0;
+
+			for (auto &sample : snapshot) {
+				uint32_t ticks = sample.capture.lowPeriod + sample.capture.highPeriod;
+				if (ticks == 0) continue;
+
+				double period = ticks * tick;
+				if (ret.count == 0) {
+					minPeriod = maxPeriod = period;
+				}
+				else {
+					minPeriod = std::min(minPeriod, period);
+					maxPeriod = std::max(maxPeriod, period);
+				}
+				sum += period;
+				sumSquare += period * period;
+				sumDuty += static_cast<double>(sample.capture.highPeriod) / ticks;
+				ret.count++;
+			}
+
+			if (snapshot.size() > 1) {
+				std::chrono::duration<double> window = snapshot.back().time - snapshot.front().time;
+				if (window.count() > 0) ret.readRate = (snapshot.size() - 1) / window.count();
+			}
+
+			if (ret.count == 0) return ret;
+
+			ret.periodMean = sum / ret.count;
+			ret.frequency = 1.0 / ret.periodMean;
+			ret.duty = sumDuty / ret.count;
+			ret.jitterRMS = std::sqrt(std::max(0.0, sumSquare / ret.count - ret.periodMean * ret.periodMean));
+			ret.jitterPeakToPeak = maxPeriod - minPeriod;
+
+			return ret;
+		}
+	};
+};
@@ -0,0 +1,98 @@
+#ifndef _LC4500_PWMCAPTURE_H_
+#define _LC4500_PWMCAPTURE_H_
+
+#include "Transaction.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <cassert>
+
+namespace LC4500 {
+	namespace DLPC350 {
+		enum class PWMCaptureChannel : uint8_t {
+			CHANNEL0 = 0, // GPIO_5
+			CHANNEL1 = 1  // GPIO_6
+		};
+
+		struct PWMCaptureConfig {
+			bool enabled;
+			uint32_t sampleRate; // 285 Hz to 18,666,667 Hz
+			PWMCaptureConfig() : enabled{ false }, sampleRate{ 0 } {}
+			PWMCaptureConfig(bool _enabled, uint32_t _sampleRate) : enabled(_enabled), sampleRate(_sampleRate) {}
+		};
+
+		struct PWMCapture {
+			uint16_t lowPeriod; // number of samples taken while the signal was low
+			uint16_t highPeriod; // number of samples taken while the signal was high
+			PWMCapture() : lowPeriod{ 0 }, highPeriod{ 0 } {}
+			PWMCapture(uint16_t _low, uint16_t _high) : lowPeriod(_low), highPeriod(_high) {}
+		};
+
+		extern std::unique_ptr<PWMCaptureConfig> getPWMCaptureConfig(PWMCaptureChannel channel);
+		extern bool setPWMCaptureConfig(PWMCaptureChannel channel, bool enable, uint32_t sampleRate);
+		extern std::unique_ptr<PWMCapture> readPWMCapture(PWMCaptureChannel channel);
+
+		/**
+		* PWMCaptureSampler
+		* Polls PWMCaptureRead continuously on a worker thread, keeping `depth` reads in flight,
+		* and stores time-stamped readings in a fixed-size ring buffer.
+		* The sampler owns the USB link while it is running; do not issue other commands until stop().
+		*/
+		class PWMCaptureSampler {
+		public:
+			using Clock = std::chrono::steady_clock;
+
+			struct Sample {
+				Clock::time_point time;
+				PWMCapture capture;
+			};
+
+			struct Statistics {
+				size_t count;            // samples with a valid (non-zero) period
+				double readRate;         // readings per second over the buffered window
+				double frequency;        // Hz
+				double duty;             // 0.0 - 1.0
+				double periodMean;       // seconds
+				double jitterRMS;        // standard deviation of the period in seconds
+				double jitterPeakToPeak; // max - min period in seconds
+				Statistics() : count{ 0 }, readRate{ 0 }, frequency{ 0 }, duty{ 0 }, periodMean{ 0 }, jitterRMS{ 0 }, jitterPeakToPeak{ 0 } {}
+			};
+
+			PWMCaptureSampler(PWMCaptureChannel channel, uint32_t sampleRate, size_t capacity = 4096, size_t depth = 8);
+			virtual ~PWMCaptureSampler();
+
+			PWMCaptureSampler(const PWMCaptureSampler&) = delete;
+			PWMCaptureSampler& operator=(const PWMCaptureSampler&) = delete;
+
+			bool start();
+			void stop();
+			inline bool isRunning() const { return running; }
+
+			std::vector<Sample> samples() const;
+			Statistics statistics() const;
+			void clear();
+
+		private:
+			void run();
+			void push(const Sample &sample);
+
+			PWMCaptureChannel channel;
+			uint32_t sampleRate;
+			size_t depth;
+
+			std::vector<Sample> buffer;
+			size_t head, count;
+			mutable std::mutex mutex;
+
+			std::atomic<bool> running;
+			std::thread worker;
+		};
+	};
+};
+
+#endif
@@ -0,0 +1,407 @@
+#include "PatternPacker.hpp"
+
+#include "../../dlpc/dlpc350_simd.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace LC4500 {
+	namespace {
+		constexpr size_t bmpHeaderSize = 54;
+		constexpr size_t maxImages = 256;
+
+		// slot of the first bit of each BMP byte (B, G, R) of a pixel
+		constexpr uint8_t channelSlot[3] = { 16, 0, 8 };
+
+		// patterns of a bit depth: 5 and 7 bit patterns skip the bits the controller leaves unused
+		inline uint8_t patternsPerImage(uint8_t bitDepth) {
+			return (bitDepth == 5) ? 4 : (bitDepth == 7) ? 3 : 24 / bitDepth;
+		}
+
+		inline uint8_t patternStartBit(uint8_t bitDepth, uint8_t patternNumber) {
+			if (bitDepth == 5) return 6 * patternNumber + 1;
+			if (bitDepth == 7) return 8 * patternNumber + 1;
+			return bitDepth * patternNumber;
+		}
+
+		inline void putLE(uint8_t *dst, uint32_t value, size_t size) {
+			for (size_t i = 0; i < size; i++, value >>= 8) dst[i] = static_cast<uint8_t>(value);
+		}
+
+		// 8x8 bit transpose of a 64-bit word, byte r bit c <-> byte c bit r
+		inline uint64_t transpose8x8(uint64_t x) {
+			uint64_t t;
+			t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAull;
+			x ^= t ^ (t << 7);
+			t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCull;
+			x ^= t ^ (t << 14);
+			t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ull;
+			x ^= t ^ (t << 28);
+			return x;
+		}
+
+		// bit rows of the 24 slots -> 3 byte pixels of bytes [first, last)
+		void packBytes(const uint8_t *const bits[24], size_t first, size_t last, uint32_t width, uint8_t *out) {
+			for (size_t i = first; i < last; i++) {
+				uint32_t count = std::min<uint32_t>(8, width - static_cast<uint32_t>(i * 8));
+				for (size_t c = 0; c < 3; c++) {
+					uint64_t x = 0;
+					for (size_t k = 0; k < 8; k++) x |= static_cast<uint64_t>(bits[channelSlot[c] + k][i]) << (8 * k);
+					x = transpose8x8(x);
+					// byte 7 - j holds pixel j
+					for (uint32_t j = 0; j < count; j++) out[(i * 8 + j) * 3 + c] = static_cast<uint8_t>(x >> (8 * (7 - j)));
+				}
+			}
+		}
+
+		// top `bitDepth` bits of one byte per pixel -> MSB-first bit rows, LSB first
+		void sliceBytes(const uint8_t *src, uint32_t first, uint32_t width, uint8_t bitDepth, uint8_t *const rows[8]) {
+			for (uint32_t x = first; x < width; x += 8) {
+				uint32_t count = std::min<uint32_t>(8, width - x);
+				for (uint8_t b = 0; b < bitDepth; b++) {
+					uint8_t shift = 8 - bitDepth + b, value = 0;
+					for (uint32_t j = 0; j < count; j++) value |= ((src[x + j] >> shift) & 1) << (7 - j);
+					rows[b][x / 8] = value;
+				}
+			}
+		}
+
+#if DLPC350_SIMD_X86
+		// pixel bytes of the three channels (each reversed within 8 byte groups) -> 16 B, G, R pixels
+		alignas(16) const int8_t interleaveMask[3][3][16] = {
+			{ {  7, -1, -1,  6, -1, -1,  5, -1, -1,  4, -1, -1,  3, -1, -1,  2 }, { -1,  7, -1, -1,  6, -1, -1,  5, -1, -1,  4, -1, -1,  3, -1, -1 }, { -1, -1,  7, -1, -1,  6, -1, -1,  5, -1, -1,  4, -1, -1,  3, -1 } },
+			{ { -1, -1,  1, -1, -1,  0, -1, -1, 15, -1, -1, 14, -1, -1, 13, -1 }, {  2, -1, -1,  1, -1, -1,  0, -1, -1, 15, -1, -1, 14, -1, -1, 13 }, { -1,  2, -1, -1,  1, -1, -1,  0, -1, -1, 15, -1, -1, 14, -1, -1 } },
+			{ { -1, 12, -1, -1, 11, -1, -1, 10, -1, -1,  9, -1, -1,  8, -1, -1 }, { -1, -1, 12, -1, -1, 11, -1, -1, 10, -1, -1,  9, -1, -1,  8, -1 }, { 13, -1, -1, 12, -1, -1, 11, -1, -1, 10, -1, -1,  9, -1, -1,  8 } }
+		};
+
+		// reverses each 8 byte group, so that movemask yields MSB-first bytes
+		alignas(16) const int8_t reverseMask[16] = { 7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8 };
+
+		DLPC350_TARGET("ssse3")
+		inline void interleaveSSSE3(const uint8_t *b, const uint8_t *g, const uint8_t *r, uint8_t *out) {
+			__m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b));
+			__m128i vg = _mm_loadu_si128(reinterpret_cast<const __m128i*>(g));
+			__m128i vr = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r));
+			for (int v = 0; v < 3; v++) {
+				__m128i o = _mm_or_si128(_mm_or_si128(
+					_mm_shuffle_epi8(vb, _mm_load_si128(reinterpret_cast<const __m128i*>(interleaveMask[v][0]))),
+					_mm_shuffle_epi8(vg, _mm_load_si128(reinterpret_cast<const __m128i*>(interleaveMask[v][1])))),
+					_mm_shuffle_epi8(vr, _mm_load_si128(reinterpret_cast<const __m128i*>(interleaveMask[v][2]))));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16 * v), o);
+			}
+		}
+
+		DLPC350_TARGET("ssse3")
+		inline __m128i transpose8x8SSSE3(__m128i x) {
+			__m128i t;
+			t = _mm_and_si128(_mm_xor_si128(x, _mm_srli_epi64(x, 7)), _mm_set1_epi64x(0x00AA00AA00AA00AAll));
+			x = _mm_xor_si128(x, _mm_xor_si128(t, _mm_slli_epi64(t, 7)));
+			t = _mm_and_si128(_mm_xor_si128(x, _mm_srli_epi64(x, 14)), _mm_set1_epi64x(0x0000CCCC0000CCCCll));
+			x = _mm_xor_si128(x, _mm_xor_si128(t, _mm_slli_epi64(t, 14)));
+			t = _mm_and_si128(_mm_xor_si128(x, _mm_srli_epi64(x, 28)), _mm_set1_epi64x(0x00000000F0F0F0F0ll));
+			x = _mm_xor_si128(x, _mm_xor_si128(t, _mm_slli_epi64(t, 28)));
+			return x;
+		}
+
+		// 16 bytes of each slot row (128 pixels) per step; returns the bytes done
+		DLPC350_TARGET("ssse3")
+		size_t packSSSE3(const uint8_t *const bits[24], size_t rowBytes, uint8_t *out) {
+			alignas(16) uint8_t channel[3][128];
+			size_t i;
+
+			for (i = 0; i + 16 <= rowBytes; i += 16, out += 128 * 3) {
+				for (int c = 0; c < 3; c++) {
+					const uint8_t *const *rows = bits + channelSlot[c];
+					__m128i p0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[0] + i));
+					__m128i p1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[1] + i));
+					__m128i p2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[2] + i));
+					__m128i p3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[3] + i));
+					__m128i p4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[4] + i));
+					__m128i p5 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[5] + i));
+					__m128i p6 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[6] + i));
+					__m128i p7 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[7] + i));
+
+					// bytes of the 8 rows side by side: 64-bit lane g holds byte g of rows 0..7
+					__m128i a0 = _mm_unpacklo_epi8(p0, p1), a1 = _mm_unpackhi_epi8(p0, p1);
+					__m128i a2 = _mm_unpacklo_epi8(p2, p3), a3 = _mm_unpackhi_epi8(p2, p3);
+					__m128i a4 = _mm_unpacklo_epi8(p4, p5), a5 = _mm_unpackhi_epi8(p4, p5);
+					__m128i a6 = _mm_unpacklo_epi8(p6, p7), a7 = _mm_unpackhi_epi8(p6, p7);
+					__m128i b0 = _mm_unpacklo_epi16(a0, a2), b1 = _mm_unpackhi_epi16(a0, a2);
+					__m128i b2 = _mm_unpacklo_epi16(a1, a3), b3 = _mm_unpackhi_epi16(a1, a3);
+					__m128i b4 = _mm_unpacklo_epi16(a4, a6), b5 = _mm_unpackhi_epi16(a4, a6);
+					__m128i b6 = _mm_unpacklo_epi16(a5, a7), b7 = _mm_unpackhi_epi16(a5, a7);
+					__m128i *dst = reinterpret_cast<__m128i*>(channel[c]);
+
+					_mm_store_si128(dst + 0, transpose8x8SSSE3(_mm_unpacklo_epi32(b0, b4)));
+					_mm_store_si128(dst + 1, transpose8x8SSSE3(_mm_unpackhi_epi32(b0, b4)));
+					_mm_store_si128(dst + 2, transpose8x8SSSE3(_mm_unpacklo_epi32(b1, b5)));
+					_mm_store_si128(dst + 3, transpose8x8SSSE3(_mm_unpackhi_epi32(b1, b5)));
+					_mm_store_si128(dst + 4, transpose8x8SSSE3(_mm_unpacklo_epi32(b2, b6)));
+					_mm_store_si128(dst + 5, transpose8x8SSSE3(_mm_unpackhi_epi32(b2, b6)));
+					_mm_store_si128(dst + 6, transpose8x8SSSE3(_mm_unpacklo_epi32(b3, b7)));
+					_mm_store_si128(dst + 7, transpose8x8SSSE3(_mm_unpackhi_epi32(b3, b7)));
+				}
+
+				for (int p = 0; p < 128; p += 16) interleaveSSSE3(channel[0] + p, channel[1] + p, channel[2] + p, out + p * 3);
+			}
+
+			return i;
+		}
+
+		DLPC350_TARGET("avx2")
+		inline __m256i transpose8x8AVX2(__m256i x) {
+			__m256i t;
+			t = _mm256_and_si256(_mm256_xor_si256(x, _mm256_srli_epi64(x, 7)), _mm256_set1_epi64x(0x00AA00AA00AA00AAll));
+			x = _mm256_xor_si256(x, _mm256_xor_si256(t, _mm256_slli_epi64(t, 7)));
+			t = _mm256_and_si256(_mm256_xor_si256(x, _mm256_srli_epi64(x, 14)), _mm256_set1_epi64x(0x0000CCCC0000CCCCll));
+			x = _mm256_xor_si256(x, _mm256_xor_si256(t, _mm256_slli_epi64(t, 14)));
+			t = _mm256_and_si256(_mm256_xor_si256(x, _mm256_srli_epi64(x, 28)), _mm256_set1_epi64x(0x00000000F0F0F0F0ll));
+			x = _mm256_xor_si256(x, _mm256_xor_si256(t, _mm256_slli_epi64(t, 28)));
+			return x;
+		}
+
+		// 32 bytes of each slot row (256 pixels) per step; returns the bytes done
+		DLPC350_TARGET("avx2")
+		size_t packAVX2(const uint8_t *const bits[24], size_t rowBytes, uint8_t *out) {
+			// channel[c][m] lane 0 holds pixels 16m.., lane 1 pixels 128 + 16m..
+			alignas(32) __m256i channel[3][8];
+			__m256i masks[3][3];
+			size_t i;
+
+			for (int v = 0; v < 3; v++) {
+				for (int c = 0; c < 3; c++) masks[v][c] = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(interleaveMask[v][c])));
+			}
+
+			for (i = 0; i + 32 <= rowBytes; i += 32, out += 256 * 3) {
+				for (int c = 0; c < 3; c++) {
+					const uint8_t *const *rows = bits + channelSlot[c];
+					__m256i p0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows[0] + i));
+					__m256i p1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows[1] + i));
+					__m256i p2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows[2] + i));
+					__m256i p3 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows[3] + i));
+					__m256i p4 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows[4] + i));
+					__m256i p5 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows[5] + i));
+					__m256i p6 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows[6] + i));
+					__m256i p7 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows[7] + i));
+
+					// as in packSSSE3, within each 128-bit lane
+					__m256i a0 = _mm256_unpacklo_epi8(p0, p1), a1 = _mm256_unpackhi_epi8(p0, p1);
+					__m256i a2 = _mm256_unpacklo_epi8(p2, p3), a3 = _mm256_unpackhi_epi8(p2, p3);
+					__m256i a4 = _mm256_unpacklo_epi8(p4, p5), a5 = _mm256_unpackhi_epi8(p4, p5);
+					__m256i a6 = _mm256_unpacklo_epi8(p6, p7), a7 = _mm256_unpackhi_epi8(p6, p7);
+					__m256i b0 = _mm256_unpacklo_epi16(a0, a2), b1 = _mm256_unpackhi_epi16(a0, a2);
+					__m256i b2 = _mm256_unpacklo_epi16(a1, a3), b3 = _mm256_unpackhi_epi16(a1, a3);
+					__m256i b4 = _mm256_unpacklo_epi16(a4, a6), b5 = _mm256_unpackhi_epi16(a4, a6);
+					__m256i b6 = _mm256_unpacklo_epi16(a5, a7), b7 = _mm256_unpackhi_epi16(a5, a7);
+
+					channel[c][0] = transpose8x8AVX2(_mm256_unpacklo_epi32(b0, b4));
+					channel[c][1] = transpose8x8AVX2(_mm256_unpackhi_epi32(b0, b4));
+					channel[c][2] = transpose8x8AVX2(_mm256_unpacklo_epi32(b1, b5));
+					channel[c][3] = transpose8x8AVX2(_mm256_unpackhi_epi32(b1, b5));
+					channel[c][4] = transpose8x8AVX2(_mm256_unpacklo_epi32(b2, b6));
+					channel[c][5] = transpose8x8AVX2(_mm256_unpackhi_epi32(b2, b6));
+					channel[c][6] = transpose8x8AVX2(_mm256_unpacklo_epi32(b3, b7));
+					channel[c][7] = transpose8x8AVX2(_mm256_unpackhi_epi32(b3, b7));
+				}
+
+				for (int m = 0; m < 8; m++) {
+					__m256i o[3];
+					for (int v = 0; v < 3; v++) {
+						o[v] = _mm256_or_si256(_mm256_or_si256(
+							_mm256_shuffle_epi8(channel[0][m], masks[v][0]),
+							_mm256_shuffle_epi8(channel[1][m], masks[v][1])),
+							_mm256_shuffle_epi8(channel[2][m], masks[v][2]));
+					}
+					_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 48 * m), _mm256_permute2x128_si256(o[0], o[1], 0x20));
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(out + 48 * m + 32), _mm256_castsi256_si128(o[2]));
+					_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 384 + 48 * m), _mm256_permute2x128_si256(o[0], o[1], 0x31));
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(out + 384 + 48 * m + 32), _mm256_extracti128_si256(o[2], 1));
+				}
+			}
+
+			return i;
+		}
+
+		// 16 pixels per step; returns the pixels done
+		DLPC350_TARGET("ssse3")
+		uint32_t sliceSSSE3(const uint8_t *src, uint32_t width, uint8_t bitDepth, uint8_t *const rows[8]) {
+			const __m128i reverse = _mm_load_si128(reinterpret_cast<const __m128i*>(reverseMask));
+			uint32_t x;
+
+			for (x = 0; x + 16 <= width; x += 16) {
+				__m128i v = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x)), reverse);
+				for (uint8_t b = 0; b < bitDepth; b++) {
+					// bit (8 - bitDepth + b) to the sign bit of each byte
+					int mask = _mm_movemask_epi8(_mm_sll_epi16(v, _mm_cvtsi32_si128(bitDepth - 1 - b)));
+					rows[b][x / 8] = static_cast<uint8_t>(mask);
+					rows[b][x / 8 + 1] = static_cast<uint8_t>(mask >> 8);
+				}
+			}
+
+			return x;
+		}
+#endif
+
+		void packRow(const uint8_t *const bits[24], uint32_t width, uint8_t *out) {
+			size_t rowBytes = (width + 7) / 8, done = 0;
+
+#if DLPC350_SIMD_X86
+			size_t (*kernel)(const uint8_t *const[24], size_t, uint8_t*) = nullptr;
+			size_t chunk = 0;
+
+			if (DLPC350_CpuFeatures() & CPU_FEATURE_AVX2) kernel = packAVX2, chunk = 32;
+			else if (DLPC350_CpuFeatures() & CPU_FEATURE_SSSE3) kernel = packSSSE3, chunk = 16;
+
+			if (kernel != nullptr) {
+				// the kernels write all 8 pixels of each byte, the last chunk goes through zero padded copies
+				done = kernel(bits, width / 8, out);
+				if (done < rowBytes) {
+					alignas(32) uint8_t tail[24][32] = {};
+					uint8_t pixels[256 * 3];
+					const uint8_t *tailBits[24];
+
+					for (size_t s = 0; s < 24; s++) {
+						memcpy(tail[s], bits[s] + done, rowBytes - done);
+						tailBits[s] = tail[s];
+					}
+					kernel(tailBits, chunk, pixels);
+					memcpy(out + done * 8 * 3, pixels, (width - done * 8) * 3);
+					done = rowBytes;
+				}
+			}
+#endif
+
+			packBytes(bits, done, rowBytes, width, out);
+		}
+
+		void sliceRow(const uint8_t *src, uint32_t width, uint8_t bitDepth, uint8_t *const rows[8]) {
+			uint32_t done = 0;
+
+#if DLPC350_SIMD_X86
+			if (DLPC350_CpuFeatures() & CPU_FEATURE_SSSE3) done = sliceSSSE3(src, width, bitDepth, rows);
+#endif
+
+			sliceBytes(src, done, width, bitDepth, rows);
+		}
+	};
+
+	bool PatternPacker::place(const Plane &plane) {
+		uint8_t bitDepth = plane.bitDepth;
+		uint32_t mask = (1u << bitDepth) - 1;
+
+		for (int attempt = 0; attempt < 2; attempt++) {
+			if (attempt == 1 || usedBits.empty()) {
+				if (usedBits.size() >= maxImages) return false;
+				usedBits.push_back(0);
+			}
+
+			uint32_t &used = usedBits.back();
+			for (uint8_t n = 0; n < patternsPerImage(bitDepth); n++) {
+				uint8_t startBit = patternStartBit(bitDepth, n);
+				if (used & (mask << startBit)) continue;
+
+				used |= mask << startBit;
+				slots.push_back(Slot{ static_cast<uint8_t>(usedBits.size() - 1), static_cast<Pattern::BitIndex>(startBit), bitDepth });
+				planes.push_back(plane);
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	bool PatternPacker::addPlane(const uint8_t *data, size_t stride, uint8_t bitDepth) {
+		if (data == nullptr || bitDepth < 1 || bitDepth > 8 || stride < width) return false;
+		return place(Plane{ data, stride, bitDepth, false });
+	}
+
+	bool PatternPacker::addPackedPlane(const uint8_t *data, size_t stride) {
+		if (data == nullptr || stride < (width + 7) / 8) return false;
+		return place(Plane{ data, stride, 1, true });
+	}
+
+	/**
+	* packPixels
+	* Per row, unpacked planes are sliced into bit rows, then the 24 bit rows (zero for unused
+	* bits) are transposed 8 pixels x 8 bits at a time into the B, G, R bytes of the pixels.
+	*/
+	bool PatternPacker::packPixels(size_t index, uint8_t *pixels, ptrdiff_t stride) const {
+		if (index >= usedBits.size() || pixels == nullptr || width == 0 || height == 0) return false;
+
+		size_t rowBytes = (width + 7) / 8;
+		std::vector<uint8_t> zero(rowBytes, 0), sliced(24 * rowBytes);
+		const uint8_t *bits[24];
+
+		for (uint32_t y = 0; y < height; y++) {
+			for (auto &row : bits) row = zero.data();
+
+			for (size_t i = 0; i < planes.size(); i++) {
+				if (slots[i].image != index) continue;
+
+				const Plane &plane = planes[i];
+				uint8_t startBit = static_cast<uint8_t>(slots[i].startBit);
+				const uint8_t *src = plane.data + y * plane.stride;
+
+				if (plane.packed) {
+					bits[startBit] = src;
+					continue;
+				}
+
+				uint8_t *rows[8];
+				for (uint8_t b = 0; b < plane.bitDepth; b++) {
+					rows[b] = &sliced[(startBit + b) * rowBytes];
+					bits[startBit + b] = rows[b];
+				}
+				sliceRow(src, width, plane.bitDepth, rows);
+			}
+
+			packRow(bits, width, pixels + static_cast<ptrdiff_t>(y) * stride);
+		}
+
+		return true;
+	}
+
+	bool PatternPacker::pack(size_t index, std::vector<uint8_t> &bmp) const {
+		if (index >= usedBits.size() || width == 0 || height == 0) return false;
+
+		size_t lineLength = (static_cast<size_t>(width) * 3 + 3) & ~static_cast<size_t>(3);
+		size_t imageSize = lineLength * height;
+
+		bmp.resize(bmpHeaderSize + imageSize);
+		uint8_t *header = bmp.data();
+		memset(header, 0, bmpHeaderSize);
+		putLE(header + 0, 0x4D42, 2);
+		putLE(header + 2, static_cast<uint32_t>(bmp.size()), 4);
+		putLE(header + 10, static_cast<uint32_t>(bmpHeaderSize), 4);
+		putLE(header + 14, 40, 4);                // DIB header size
+		putLE(header + 18, width, 4);
+		putLE(header + 22, height, 4);
+		putLE(header + 26, 1, 2);                 // color planes
+		putLE(header + 28, 24, 2);                // bits per pixel
+		putLE(header + 34, static_cast<uint32_t>(imageSize), 4);
+		putLE(header + 38, 2835, 4);              // 72 DPI
+		putLE(header + 42, 2835, 4);
+
+		// bottom-up rows: the top row is the last line
+		uint8_t *lastLine = bmp.data() + bmpHeaderSize + (height - 1) * lineLength;
+		packPixels(index, lastLine, -static_cast<ptrdiff_t>(lineLength));
+		if (lineLength != width * 3u) {
+			for (uint32_t y = 0; y < height; y++) memset(lastLine - y * lineLength + width * 3, 0, lineLength - width * 3);
+		}
+
+		return true;
+	}
+
+	bool PatternPacker::addToSequence(PatternSequence &patternSequence, uint8_t firstImage, Pattern::Color color,
+		Pattern::TriggerType triggerType, bool invertPattern, bool insertBlack) const {
+		if (patternSequence.sizePattern() + slots.size() > maxPatternInSequence) return false;
+		if (firstImage + usedBits.size() > maxImages) return false;
+
+		for (auto &slot : slots) {
+			patternSequence.addPattern(color, triggerType, slot.bitDepth, static_cast<uint8_t>(firstImage + slot.image),
+				slot.startBit, invertPattern, insertBlack);
+		}
+
+		return true;
+	}
+};
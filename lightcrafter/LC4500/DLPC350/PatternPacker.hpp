@@ -0,0 +1,73 @@
+#ifndef _LC4500_PATTERNPACKER_H_
+#define _LC4500_PATTERNPACKER_H_
+
+#include "PatternSequence.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace LC4500 {
+	/**
+	* PatternPacker
+	* Packs pattern planes into 24-bit flash images in the bit order the controller addresses
+	* them (Pattern::BitIndex G0..B7), and emits the matching PatternSequence entries.
+	* Each plane takes the first free pattern of its bit depth in the current image; a new
+	* image is opened when none is left. Packing transposes 8x8 bit blocks with SIMD.
+	*/
+	class PatternPacker {
+	public:
+		struct Slot {
+			uint8_t image;             // index among the packed images
+			Pattern::BitIndex startBit;
+			uint8_t bitDepth;
+		};
+
+		PatternPacker(uint32_t _width, uint32_t _height) : width(_width), height(_height) {}
+
+		void clear() {
+			planes.clear();
+			slots.clear();
+			usedBits.clear();
+		}
+
+		// one pixel per byte, top row first; the pattern value is in the top `bitDepth` bits,
+		// so 8-bit gray images can be passed as they are
+		bool addPlane(const uint8_t *data, size_t stride, uint8_t bitDepth);
+
+		// 1-bit plane, 8 pixels per byte with the leftmost pixel in the most significant bit
+		// (1-bit BMP / packbits order), top row first
+		bool addPackedPlane(const uint8_t *data, size_t stride);
+
+		inline size_t numPlanes() const { return planes.size(); }
+		inline size_t numImages() const { return usedBits.size(); }
+		inline const Slot& getSlot(size_t plane) const { return slots[plane]; }
+
+		// writes image `index` as a bottom-up 24-bit BMP file, as taken by DLPC350_Frmw_SPLASH_AddSplash
+		bool pack(size_t index, std::vector<uint8_t> &bmp) const;
+
+		// writes the B, G, R pixels of image `index`, row y at pixels + y * stride (negative for bottom-up)
+		bool packPixels(size_t index, uint8_t *pixels, ptrdiff_t stride) const;
+
+		// appends one pattern per plane, in the order they were added; packed image i is flash image firstImage + i
+		bool addToSequence(PatternSequence &patternSequence, uint8_t firstImage, Pattern::Color color,
+			Pattern::TriggerType triggerType, bool invertPattern = false, bool insertBlack = true) const;
+
+	private:
+		struct Plane {
+			const uint8_t *data;
+			size_t stride;
+			uint8_t bitDepth;
+			bool packed;
+		};
+
+		bool place(const Plane &plane);
+
+		uint32_t width, height;
+		std::vector<Plane> planes;
+		std::vector<Slot> slots;
+		std::vector<uint32_t> usedBits; // per image
+	};
+};
+
+#endif
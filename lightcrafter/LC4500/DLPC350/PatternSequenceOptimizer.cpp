@@ -0,0 +1,102 @@
+#include "PatternSequenceOptimizer.hpp"
+
+#include <algorithm>
+
+namespace LC4500 {
+	namespace {
+		constexpr size_t maxImageInSequence = 64;
+	};
+
+	size_t PatternSequenceOptimizer::countImageLoads(const std::vector<Entry> &entries, const std::vector<size_t> &order) {
+		size_t loads = 0;
+		for (size_t i = 0; i < order.size(); i++) {
+			if (i == 0 || entries[order[i]].imageIndex != entries[order[i - 1]].imageIndex) loads++;
+		}
+		return loads;
+	}
+
+	/**
+	* optimize
+	* Greedy topological sort: stay on the resident image while any of its patterns is ready,
+	* otherwise switch to the image with the most ready patterns (earliest inserted on ties).
+	* Returns nullptr if the constraints are cyclic or the result does not fit the LUTs.
+	*/
+	std::unique_ptr<PatternSequenceOptimizer::Report> PatternSequenceOptimizer::optimize(PatternSequence &patternSequence, uint32_t framePeriod, const DLPC350::ImageLoadBenchmark *benchmark) const {
+		size_t n = entries.size();
+		if (n == 0 || n > maxPatternInSequence) return nullptr;
+
+		std::vector<size_t> indegree(n, 0);
+		std::vector<std::vector<size_t>> successors(n);
+		for (auto &constraint : constraints) {
+			successors[constraint.first].push_back(constraint.second);
+			indegree[constraint.second]++;
+		}
+
+		std::vector<bool> ready(n, false), emitted(n, false);
+		for (size_t i = 0; i < n; i++) ready[i] = (indegree[i] == 0);
+
+		std::unique_ptr<Report> report(new Report());
+		report->order.reserve(n);
+
+		int currentImage = -1;
+		for (size_t step = 0; step < n; step++) {
+			size_t next = n;
+
+			for (size_t i = 0; i < n && currentImage >= 0; i++) {
+				if (ready[i] && entries[i].imageIndex == currentImage) {
+					next = i;
+					break;
+				}
+			}
+
+			if (next == n) {
+				size_t readyPerImage[256] = { 0 };
+				for (size_t i = 0; i < n; i++) {
+					if (ready[i]) readyPerImage[entries[i].imageIndex]++;
+				}
+				for (size_t i = 0; i < n; i++) {
+					if (!ready[i]) continue;
+					if (next == n || readyPerImage[entries[i].imageIndex] > readyPerImage[entries[next].imageIndex]) next = i;
+				}
+			}
+
+			if (next == n) return nullptr; // cyclic constraints
+
+			ready[next] = false;
+			emitted[next] = true;
+			currentImage = entries[next].imageIndex;
+			report->order.push_back(next);
+
+			for (auto successor : successors[next]) {
+				if (--indegree[successor] == 0 && !emitted[successor]) ready[successor] = true;
+			}
+		}
+
+		std::vector<size_t> insertion(n);
+		for (size_t i = 0; i < n; i++) insertion[i] = i;
+
+		report->imageLoads = countImageLoads(entries, report->order);
+		report->originalImageLoads = countImageLoads(entries, insertion);
+		if (report->imageLoads > maxImageInSequence) return nullptr;
+
+		patternSequence.clear();
+		for (auto index : report->order) {
+			const Entry &entry = entries[index];
+			patternSequence.addPattern(entry.color, entry.triggerType, entry.bitDepth, entry.imageIndex,
+				entry.startBit, entry.invertPattern, entry.insertBlack);
+		}
+
+		// A buffer swap whose image takes longer to load than one frame stretches that slot to the load time.
+		for (size_t i = 0; i < patternSequence.sizePattern(); i++) {
+			double slot = framePeriod;
+			Pattern &pattern = patternSequence.getPattern(i);
+			if (pattern.data.bufferSwap && benchmark != nullptr) {
+				auto result = benchmark->find(pattern.imageIndex);
+				if (result != nullptr) slot = std::max(slot, result->mean);
+			}
+			report->duration += slot;
+		}
+
+		return report;
+	}
+};
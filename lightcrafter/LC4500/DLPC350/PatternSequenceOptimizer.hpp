@@ -0,0 +1,85 @@
+#ifndef _LC4500_PATTERNSEQUENCEOPTIMIZER_H_
+#define _LC4500_PATTERNSEQUENCEOPTIMIZER_H_
+
+#include "PatternSequence.hpp"
+#include "ImageLoadBenchmark.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <utility>
+
+namespace LC4500 {
+	/**
+	* PatternSequenceOptimizer
+	* Collects patterns and ordering constraints, then emits them into a PatternSequence in an order
+	* that keeps each flash image resident for as many consecutive patterns as the constraints allow,
+	* so every buffer swap (and image LUT entry) loads an image whose bit planes are all used in one go.
+	*/
+	class PatternSequenceOptimizer {
+	public:
+		struct Report {
+			size_t imageLoads;         // buffer swaps in the optimized sequence
+			size_t originalImageLoads; // buffer swaps in insertion order
+			double duration;           // predicted microseconds per sequence pass
+			std::vector<size_t> order; // insertion indices in emitted order
+			Report() : imageLoads{ 0 }, originalImageLoads{ 0 }, duration{ 0 } {}
+		};
+
+		PatternSequenceOptimizer() {}
+
+		void clear() {
+			entries.clear();
+			constraints.clear();
+		}
+
+		size_t addPattern(
+			Pattern::Color color,
+			Pattern::TriggerType triggerType,
+			uint8_t bitDepth,
+			uint8_t imageIndex,
+			Pattern::BitIndex startBit,
+			bool invertPattern = false,
+			bool insertBlack = true) {
+			entries.push_back(Entry{ color, triggerType, bitDepth, imageIndex, startBit, invertPattern, insertBlack });
+			return entries.size() - 1;
+		}
+
+		// pattern `first` must be displayed before pattern `second`
+		bool before(size_t first, size_t second) {
+			if (first >= entries.size() || second >= entries.size() || first == second) return false;
+			constraints.push_back(std::make_pair(first, second));
+			return true;
+		}
+
+		// patterns [first, last] keep their insertion order
+		bool keepOrder(size_t first, size_t last) {
+			for (size_t i = first; i < last; i++) {
+				if (!before(i, i + 1)) return false;
+			}
+			return true;
+		}
+
+		inline size_t size() const { return entries.size(); }
+
+		std::unique_ptr<Report> optimize(PatternSequence &patternSequence, uint32_t framePeriod, const DLPC350::ImageLoadBenchmark *benchmark = nullptr) const;
+
+	private:
+		struct Entry {
+			Pattern::Color color;
+			Pattern::TriggerType triggerType;
+			uint8_t bitDepth;
+			uint8_t imageIndex;
+			Pattern::BitIndex startBit;
+			bool invertPattern;
+			bool insertBlack;
+		};
+
+		static size_t countImageLoads(const std::vector<Entry> &entries, const std::vector<size_t> &order);
+
+		std::vector<Entry> entries;
+		std::vector<std::pair<size_t, size_t>> constraints;
+	};
+};
+
+#endif
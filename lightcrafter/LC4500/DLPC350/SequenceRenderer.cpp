@@ -0,0 +1,280 @@
+#include "SequenceRenderer.hpp"
+
+#include "../../dlpc/dlpc350_simd.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+namespace LC4500 {
+	namespace {
+		constexpr uint32_t rowsPerTask = 16;
+
+		// BMP byte (B, G, R) holding the bits of each slot group G, R, B
+		constexpr int groupByte[3] = { 1, 2, 0 };
+
+		// how one pattern's bits are taken from a pixel: the bytes holding them form a 16-bit word
+		// (lo | hi << 8), shifted so the pattern's top bit becomes bit 15
+		struct Extract {
+			int lo, hi;      // byte offsets in the pixel, hi -1 when the bits fit in lo
+			int shift;
+			uint8_t mask;    // top bitDepth bits
+			uint8_t invert;  // mask for inverted patterns, else 0
+		};
+
+		inline uint8_t patternsPerImage(uint8_t bitDepth) {
+			return (bitDepth == 5) ? 4 : (bitDepth == 7) ? 3 : 24 / bitDepth;
+		}
+
+		inline uint8_t patternStartBit(uint8_t bitDepth, uint8_t patternNumber) {
+			if (bitDepth == 5) return 6 * patternNumber + 1;
+			if (bitDepth == 7) return 8 * patternNumber + 1;
+			return bitDepth * patternNumber;
+		}
+
+		bool makeExtract(const Pattern &pattern, Extract &extract) {
+			uint8_t bitDepth = pattern.data.bitDepth;
+			if (bitDepth < 1 || bitDepth > 8 || pattern.data.patternNumber >= patternsPerImage(bitDepth)) return false;
+
+			uint8_t startBit = patternStartBit(bitDepth, pattern.data.patternNumber);
+			int group = startBit / 8, first = startBit % 8;
+
+			extract.lo = groupByte[group];
+			extract.hi = (first + bitDepth > 8) ? groupByte[group + 1] : -1;
+			extract.shift = 16 - first - bitDepth;
+			extract.mask = static_cast<uint8_t>(0xFF << (8 - bitDepth));
+			extract.invert = pattern.data.invertPattern ? extract.mask : 0;
+			return true;
+		}
+
+		void extractBytes(const uint8_t *src, uint32_t first, uint32_t width, const Extract &e, uint8_t *out) {
+			for (uint32_t x = first; x < width; x++) {
+				uint32_t word = src[x * 3 + e.lo] | ((e.hi < 0) ? 0 : src[x * 3 + e.hi] << 8);
+				out[x] = (static_cast<uint8_t>((word << e.shift) >> 8) & e.mask) ^ e.invert;
+			}
+		}
+
+#if DLPC350_SIMD_X86
+		// byte b of 16 B, G, R pixels spread over 3 registers -> one register per byte
+		alignas(16) const int8_t deinterleaveMask[3][3][16] = {
+			{ {  0,  3,  6,  9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 }, { -1, -1, -1, -1, -1, -1,  2,  5,  8, 11, 14, -1, -1, -1, -1, -1 }, { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  1,  4,  7, 10, 13 } },
+			{ {  1,  4,  7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 }, { -1, -1, -1, -1, -1,  0,  3,  6,  9, 12, 15, -1, -1, -1, -1, -1 }, { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  2,  5,  8, 11, 14 } },
+			{ {  2,  5,  8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 }, { -1, -1, -1, -1, -1,  1,  4,  7, 10, 13, -1, -1, -1, -1, -1, -1 }, { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  0,  3,  6,  9, 12, 15 } }
+		};
+
+		DLPC350_TARGET("ssse3")
+		inline __m128i deinterleaveSSSE3(__m128i v0, __m128i v1, __m128i v2, int byte) {
+			return _mm_or_si128(_mm_or_si128(
+				_mm_shuffle_epi8(v0, _mm_load_si128(reinterpret_cast<const __m128i*>(deinterleaveMask[byte][0]))),
+				_mm_shuffle_epi8(v1, _mm_load_si128(reinterpret_cast<const __m128i*>(deinterleaveMask[byte][1])))),
+				_mm_shuffle_epi8(v2, _mm_load_si128(reinterpret_cast<const __m128i*>(deinterleaveMask[byte][2]))));
+		}
+
+		// 16 pixels per step; returns the pixels done
+		DLPC350_TARGET("ssse3")
+		uint32_t extractSSSE3(const uint8_t *src, uint32_t width, const Extract &e, uint8_t *out) {
+			const __m128i shift = _mm_cvtsi32_si128(e.shift), byteShift = _mm_cvtsi32_si128(e.shift - 8);
+			const __m128i mask = _mm_set1_epi8(static_cast<char>(e.mask));
+			const __m128i invert = _mm_set1_epi8(static_cast<char>(e.invert));
+			uint32_t x;
+
+			for (x = 0; x + 16 <= width; x += 16) {
+				const uint8_t *p = src + x * 3;
+				__m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+				__m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16));
+				__m128i v2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 32));
+				__m128i lo = deinterleaveSSSE3(v0, v1, v2, e.lo), o;
+
+				if (e.hi < 0) {
+					// bits a byte shifts into its neighbour stay below the mask
+					o = _mm_sll_epi16(lo, byteShift);
+				}
+				else {
+					__m128i hi = deinterleaveSSSE3(v0, v1, v2, e.hi);
+					__m128i w0 = _mm_srli_epi16(_mm_sll_epi16(_mm_unpacklo_epi8(lo, hi), shift), 8);
+					__m128i w1 = _mm_srli_epi16(_mm_sll_epi16(_mm_unpackhi_epi8(lo, hi), shift), 8);
+					o = _mm_packus_epi16(w0, w1);
+				}
+				o = _mm_xor_si128(_mm_and_si128(o, mask), invert);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), o);
+			}
+
+			return x;
+		}
+
+		DLPC350_TARGET("avx2")
+		inline __m256i deinterleaveAVX2(__m256i v0, __m256i v1, __m256i v2, int byte) {
+			return _mm256_or_si256(_mm256_or_si256(
+				_mm256_shuffle_epi8(v0, _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(deinterleaveMask[byte][0])))),
+				_mm256_shuffle_epi8(v1, _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(deinterleaveMask[byte][1]))))),
+				_mm256_shuffle_epi8(v2, _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(deinterleaveMask[byte][2])))));
+		}
+
+		DLPC350_TARGET("avx2")
+		inline __m256i loadLanesAVX2(const uint8_t *lane0, const uint8_t *lane1) {
+			return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(lane0))),
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(lane1)), 1);
+		}
+
+		// 32 pixels per step, pixels 0..15 in the low lane and 16..31 in the high lane; returns the pixels done
+		DLPC350_TARGET("avx2")
+		uint32_t extractAVX2(const uint8_t *src, uint32_t width, const Extract &e, uint8_t *out) {
+			const __m128i shift = _mm_cvtsi32_si128(e.shift), byteShift = _mm_cvtsi32_si128(e.shift - 8);
+			const __m256i mask = _mm256_set1_epi8(static_cast<char>(e.mask));
+			const __m256i invert = _mm256_set1_epi8(static_cast<char>(e.invert));
+			uint32_t x;
+
+			for (x = 0; x + 32 <= width; x += 32) {
+				const uint8_t *p = src + x * 3;
+				__m256i v0 = loadLanesAVX2(p, p + 48);
+				__m256i v1 = loadLanesAVX2(p + 16, p + 64);
+				__m256i v2 = loadLanesAVX2(p + 32, p + 80);
+				__m256i lo = deinterleaveAVX2(v0, v1, v2, e.lo), o;
+
+				if (e.hi < 0) {
+					o = _mm256_sll_epi16(lo, byteShift);
+				}
+				else {
+					// unpack and pack both stay within lanes, so the pixel order is kept
+					__m256i hi = deinterleaveAVX2(v0, v1, v2, e.hi);
+					__m256i w0 = _mm256_srli_epi16(_mm256_sll_epi16(_mm256_unpacklo_epi8(lo, hi), shift), 8);
+					__m256i w1 = _mm256_srli_epi16(_mm256_sll_epi16(_mm256_unpackhi_epi8(lo, hi), shift), 8);
+					o = _mm256_packus_epi16(w0, w1);
+				}
+				o = _mm256_xor_si256(_mm256_and_si256(o, mask), invert);
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x), o);
+			}
+
+			return x;
+		}
+#endif
+
+		void extractRow(const uint8_t *src, uint32_t width, const Extract &e, uint8_t *out) {
+			uint32_t done = 0;
+
+#if DLPC350_SIMD_X86
+			if (DLPC350_CpuFeatures() & CPU_FEATURE_AVX2) done = extractAVX2(src, width, e, out);
+			else if (DLPC350_CpuFeatures() & CPU_FEATURE_SSSE3) done = extractSSSE3(src, width, e, out);
+#endif
+
+			extractBytes(src, done, width, e, out);
+		}
+	};
+
+	bool SequenceRenderer::setImage(uint8_t index, const uint8_t *pixels, ptrdiff_t stride) {
+		if (pixels == nullptr || (stride >= 0 ? stride : -stride) < static_cast<ptrdiff_t>(width) * 3) return false;
+		images[index] = Image{ pixels, stride };
+		return true;
+	}
+
+	void SequenceRenderer::clearImages() {
+		std::fill(images.begin(), images.end(), Image{ nullptr, 0 });
+	}
+
+	bool SequenceRenderer::renderPattern(const Pattern &pattern, uint8_t image, uint8_t *out, ptrdiff_t stride) const {
+		const Image &source = images[image];
+		Extract extract;
+
+		if (out == nullptr || source.pixels == nullptr || !makeExtract(pattern, extract)) return false;
+
+		for (uint32_t y = 0; y < height; y++) {
+			if (pattern.data.color == Pattern::Color::PASS) std::fill_n(out + static_cast<ptrdiff_t>(y) * stride, width, 0);
+			else extractRow(source.pixels + static_cast<ptrdiff_t>(y) * source.stride, width, extract, out + static_cast<ptrdiff_t>(y) * stride);
+		}
+
+		return true;
+	}
+
+	bool SequenceRenderer::render(PatternSequence &patternSequence, std::vector<Frame> &frames, size_t numThreads) const {
+		std::vector<uint8_t> imageLut(patternSequence.sizeImage());
+		for (size_t i = 0; i < imageLut.size(); i++) imageLut[i] = patternSequence.getImage(i);
+		return render(patternSequence, imageLut, frames, numThreads);
+	}
+
+	/**
+	* render
+	* Resolves each pattern's image and bits first, then splits the runs of patterns on the same
+	* image into bands of rows that the threads take in turn.
+	*/
+	bool SequenceRenderer::render(PatternSequence &patternSequence, const std::vector<uint8_t> &imageLut,
+		std::vector<Frame> &frames, size_t numThreads) const {
+		size_t numPatterns = patternSequence.sizePattern();
+		std::vector<Extract> extracts;
+		std::vector<size_t> lit; // frames whose bits are extracted, in order
+		size_t lutEntry = 0, numFrames = 0;
+
+		auto addFrame = [&](const Pattern &pattern, size_t index, uint8_t image, bool black) -> Frame& {
+			if (numFrames == frames.size()) frames.emplace_back();
+			Frame &frame = frames[numFrames++];
+			frame.pixels.resize(static_cast<size_t>(width) * height);
+			frame.bitDepth = pattern.data.bitDepth;
+			frame.color = pattern.data.color;
+			frame.black = black;
+			frame.image = image;
+			frame.pattern = index;
+			return frame;
+		};
+
+		for (size_t i = 0; i < numPatterns; i++) {
+			const Pattern &pattern = patternSequence.getPattern(i);
+			Extract extract;
+
+			// the controller moves to the next image LUT entry on each buffer swap
+			if (pattern.data.bufferSwap && i > 0) lutEntry++;
+			if (lutEntry >= imageLut.size() || images[imageLut[lutEntry]].pixels == nullptr) return false;
+			if (!makeExtract(pattern, extract)) return false;
+
+			Frame &frame = addFrame(pattern, i, imageLut[lutEntry], false);
+			if (pattern.data.color == Pattern::Color::PASS) {
+				std::fill(frame.pixels.begin(), frame.pixels.end(), 0);
+			}
+			else {
+				lit.push_back(numFrames - 1);
+				extracts.push_back(extract);
+			}
+
+			if (pattern.data.insertBlack) {
+				Frame &black = addFrame(pattern, i, imageLut[lutEntry], true);
+				std::fill(black.pixels.begin(), black.pixels.end(), 0);
+			}
+		}
+		frames.resize(numFrames);
+
+		// patterns shown from the same image in a row share each source row while it is in cache
+		std::vector<size_t> groupStart;
+		for (size_t i = 0; i < lit.size(); i++) {
+			if (i == 0 || frames[lit[i]].image != frames[lit[i - 1]].image) groupStart.push_back(i);
+		}
+		groupStart.push_back(lit.size());
+
+		size_t bandsPerGroup = (height + rowsPerTask - 1) / rowsPerTask;
+		size_t numTasks = (groupStart.size() - 1) * bandsPerGroup;
+		std::atomic<size_t> nextTask(0);
+
+		auto work = [&]() {
+			for (size_t task; (task = nextTask++) < numTasks;) {
+				size_t group = task / bandsPerGroup;
+				const Image &source = images[frames[lit[groupStart[group]]].image];
+				uint32_t first = static_cast<uint32_t>(task % bandsPerGroup) * rowsPerTask;
+				uint32_t last = std::min(first + rowsPerTask, height);
+
+				for (uint32_t y = first; y < last; y++) {
+					const uint8_t *src = source.pixels + static_cast<ptrdiff_t>(y) * source.stride;
+					for (size_t i = groupStart[group]; i < groupStart[group + 1]; i++) {
+						extractRow(src, width, extracts[i], frames[lit[i]].pixels.data() + static_cast<size_t>(y) * width);
+					}
+				}
+			}
+		};
+
+		if (numThreads == 0) numThreads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+		numThreads = std::min(numThreads, numTasks);
+
+		std::vector<std::thread> workers;
+		for (size_t i = 1; i < numThreads; i++) workers.push_back(std::thread(work));
+		work();
+		for (auto &worker : workers) worker.join();
+
+		return true;
+	}
+};
@@ -0,0 +1,66 @@
+#ifndef _LC4500_SEQUENCERENDERER_H_
+#define _LC4500_SEQUENCERENDERER_H_
+
+#include "PatternSequence.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace LC4500 {
+	/**
+	* SequenceRenderer
+	* Renders on the host what the DMD shows for each entry of a pattern sequence, from the
+	* 24-bit flash images the image LUT points at, so sequences can be checked without hardware.
+	* The controller's selection is followed exactly: buffer swaps step through the image LUT,
+	* bitDepth and patternNumber pick the bits (Pattern::BitIndex order), invertPattern flips them.
+	* A pattern with Color::PASS lights no LED and renders black; insertBlack adds a black frame
+	* after its pattern. Rows are extracted with SIMD and the entries are rendered on several threads.
+	*/
+	class SequenceRenderer {
+	public:
+		struct Frame {
+			std::vector<uint8_t> pixels; // width * height, top row first, value in the top bitDepth bits; 0 when dark
+			uint8_t bitDepth;
+			Pattern::Color color;        // LEDs lit while the frame shows, PASS = none
+			bool black;                  // inserted by insertBlack: the DMD is cleared for the rest of the pattern period
+			uint8_t image;               // flash image the bits were taken from
+			size_t pattern;              // index of the pattern in the sequence
+		};
+
+		SequenceRenderer(uint32_t _width, uint32_t _height) : width(_width), height(_height), images(maxImages) {}
+
+		/*
+		* Flash image `index`: B, G, R pixels, row y at pixels + y * stride, as
+		* DLPC350_Frmw_GetSpashImage writes them (stride = width * 3). The pixels are not copied.
+		*/
+		bool setImage(uint8_t index, const uint8_t *pixels, ptrdiff_t stride);
+		void clearImages();
+
+		/*
+		* One frame per pattern of the sequence, each followed by a black frame if the pattern has
+		* insertBlack. The image LUT is the sequence's own, or imageLut when given. Previous frames
+		* are reused. numThreads 0 = one per core. Fails if a pattern has no valid bits or refers to
+		* an image that has not been set.
+		*/
+		bool render(PatternSequence &patternSequence, std::vector<Frame> &frames, size_t numThreads = 0) const;
+		bool render(PatternSequence &patternSequence, const std::vector<uint8_t> &imageLut,
+			std::vector<Frame> &frames, size_t numThreads = 0) const;
+
+		// a single pattern shown from flash image `image`, into width bytes per row at out + y * stride; black for PASS
+		bool renderPattern(const Pattern &pattern, uint8_t image, uint8_t *out, ptrdiff_t stride) const;
+
+	private:
+		static const size_t maxImages = 256;
+
+		struct Image {
+			const uint8_t *pixels;
+			ptrdiff_t stride;
+		};
+
+		uint32_t width, height;
+		std::vector<Image> images;
+	};
+};
+
+#endif
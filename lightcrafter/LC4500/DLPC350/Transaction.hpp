@@ -3,6 +3,8 @@
 
 #include <cstdint>
 #include <algorithm>
+#include <atomic>
+#include <vector>
 
 #include "../USB/USB.hpp"
 
@@ -60,14 +62,20 @@ namespace LC4500 {
 			};
 		};
 		
+		// rolling value for Transaction::sequence; the controller echoes it in the reply
+		extern inline uint8_t nextSequence() {
+			static std::atomic<uint8_t> sequence(0);
+			return ++sequence;
+		}
+
 		extern inline std::unique_ptr<Transaction> read() {
 			auto received = USB::read();
 
+			if (received == nullptr) return nullptr;
+
 			auto ret = std::unique_ptr<Transaction>(new Transaction(), std::default_delete<Transaction>());
 			memcpy(ret.get(), received.get(), USB::bufferSize);
 
-			if (received == nullptr) return nullptr;
-
 			return ret;
 		}
 
@@ -98,28 +106,95 @@ namespace LC4500 {
 		using TransactionData = std::unique_ptr<T, std::default_delete<T[]>>;
 
 		template<typename T = uint8_t>
-		extern TransactionData<T> transact(Transaction &tran) {
-			int32_t result = write(tran);
+		extern inline TransactionData<T> replyData(const std::unique_ptr<Transaction> &received) {
+			if (received == nullptr) return nullptr;
+			if (received->flags.error ||
+				(received->flags.rw == Transaction::Type::READ && received->length == 0)) return nullptr;
 
-			if (tran.flags.reply) {
-				if (result <= 0) return nullptr;
+			TransactionData<T> ret(new T[USB::maxPacketSize]);
+			memcpy(ret.get(), received->data, USB::maxPacketSize);
 
-				auto received = read();
+			return ret;
+		}
 
+		template<typename T = uint8_t>
+		extern inline TransactionData<T> receive() {
+			return replyData<T>(read());
+		}
+
+		/**
+		* receive
+		* Reads the reply to the request sent with `sequence`. Older replies, left over from requests
+		* that failed, are dropped. A newer one means this reply was lost: it is kept in `pending`
+		* for its own request and nullptr is returned.
+		*/
+		template<typename T = uint8_t>
+		extern inline TransactionData<T> receive(uint8_t sequence, std::unique_ptr<Transaction> &pending) {
+			while (true) {
+				auto received = (pending != nullptr) ? std::move(pending) : read();
 				if (received == nullptr) return nullptr;
-				if (received->flags.error ||
-					(received->flags.rw == Transaction::Type::READ && received->length == 0)) return nullptr;
 
-				TransactionData<T> ret(new T[USB::maxPacketSize]);
-				memcpy(ret.get(), received->data, USB::maxPacketSize);
+				int8_t ahead = static_cast<int8_t>(received->sequence - sequence);
+				if (ahead == 0) return replyData<T>(received);
+				if (ahead > 0) {
+					pending = std::move(received);
+					return nullptr;
+				}
+			}
+		}
+
+		template<typename T = uint8_t>
+		extern TransactionData<T> transact(Transaction &tran) {
+			tran.sequence = nextSequence();
+			int32_t result = write(tran);
+
+			if (tran.flags.reply) {
+				if (result <= 0) return nullptr;
 
-				return ret;
+				std::unique_ptr<Transaction> pending;
+				return receive<T>(tran.sequence, pending);
 			}
 			else {
 				return nullptr;
 			}
 		}
 
+		/**
+		* transactPipelined
+		* Keeps up to `depth` transactions in flight instead of waiting for each reply
+		* before sending the next request. Each request carries its own sequence number and
+		* its reply must echo it, so a lost or stale reply fails only that slot (nullptr).
+		* After a write failure the remaining slots are nullptr; the replies to the requests
+		* already sent are still received, so none are left in the queue.
+		*/
+		template<typename T = uint8_t>
+		extern std::vector<TransactionData<T>> transactPipelined(std::vector<Transaction> &trans, size_t depth) {
+			std::vector<TransactionData<T>> ret(trans.size());
+			std::unique_ptr<Transaction> pending;
+			depth = std::max<size_t>(depth, 1);
+
+			size_t sent = 0, received = 0;
+			bool writing = true;
+			while (true) {
+				while (writing && sent < trans.size() && sent - received < depth) {
+					trans[sent].sequence = nextSequence();
+					if (write(trans[sent]) <= 0) {
+						writing = false;
+						break;
+					}
+					sent++;
+				}
+				if (received == sent) break;
+
+				if (trans[received].flags.reply) {
+					ret[received] = receive<T>(trans[received].sequence, pending);
+				}
+				received++;
+			}
+
+			return ret;
+		}
+
 		template<typename T = uint8_t>
 		extern inline TransactionData<T> transactForGetValues(uint16_t cmd) {
 			auto send = Transaction(Transaction::Type::READ, cmd);
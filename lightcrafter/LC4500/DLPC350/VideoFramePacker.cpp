@@ -0,0 +1,150 @@
+#include "VideoFramePacker.hpp"
+
+#include <algorithm>
+
+namespace LC4500 {
+	VideoFramePacker::VideoFramePacker(uint32_t _width, uint32_t _height, uint8_t _bitDepth, size_t numThreads, size_t _maxFramesInFlight) :
+		width(_width), height(_height), bitDepth(std::max<uint8_t>(1, std::min<uint8_t>(_bitDepth, 8))),
+		maxFramesInFlight(std::max<size_t>(_maxFramesInFlight, 1)), closed(false), stopping(false) {
+		// 5 and 7 bit patterns leave bits unused, as in PatternPacker
+		_patternsPerFrame = (bitDepth == 5) ? 4 : (bitDepth == 7) ? 3 : 24 / bitDepth;
+
+		if (numThreads == 0) numThreads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+		numThreads = std::min(numThreads, maxFramesInFlight);
+		for (size_t i = 0; i < numThreads; i++) workers.push_back(std::thread(&VideoFramePacker::run, this));
+	}
+
+	VideoFramePacker::~VideoFramePacker() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+			closed = true;
+		}
+		workAvailable.notify_all();
+		spaceAvailable.notify_all();
+		frameReady.notify_all();
+		for (auto &worker : workers) worker.join();
+	}
+
+	bool VideoFramePacker::addPlane(const uint8_t *data, size_t stride) {
+		return add(data, stride, false);
+	}
+
+	bool VideoFramePacker::addPackedPlane(const uint8_t *data, size_t stride) {
+		if (bitDepth != 1) return false;
+		return add(data, stride, true);
+	}
+
+	bool VideoFramePacker::add(const uint8_t *data, size_t stride, bool packed) {
+		std::unique_lock<std::mutex> lock(mutex);
+		if (closed) return false;
+
+		// a new frame waits for room, the one being filled does not
+		if (frames.empty() || frames.back()->state != State::FILLING) {
+			spaceAvailable.wait(lock, [&] { return stopping || frames.size() < maxFramesInFlight; });
+			if (stopping) return false;
+			frames.push_back(std::unique_ptr<Frame>(new Frame(width, height)));
+		}
+
+		PatternPacker &packer = frames.back()->packer;
+		if (!(packed ? packer.addPackedPlane(data, stride) : packer.addPlane(data, stride, bitDepth))) return false;
+
+		if (packer.numPlanes() == _patternsPerFrame) queueCurrent(lock);
+		return true;
+	}
+
+	void VideoFramePacker::queueCurrent(std::unique_lock<std::mutex> &lock) {
+		Frame &frame = *frames.back();
+		frame.state = State::QUEUED;
+		if (!spare.empty()) {
+			frame.pixels.swap(spare.back());
+			spare.pop_back();
+		}
+		lock.unlock();
+		workAvailable.notify_one();
+		lock.lock();
+	}
+
+	void VideoFramePacker::flush() {
+		std::unique_lock<std::mutex> lock(mutex);
+		if (!frames.empty() && frames.back()->state == State::FILLING) queueCurrent(lock);
+	}
+
+	void VideoFramePacker::close() {
+		flush();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			closed = true;
+		}
+		frameReady.notify_all();
+	}
+
+	bool VideoFramePacker::nextFrame(std::vector<uint8_t> &frame) {
+		std::unique_lock<std::mutex> lock(mutex);
+
+		// the oldest frame is packed, or nothing more will come
+		frameReady.wait(lock, [&] {
+			if (stopping || frames.empty()) return stopping || closed;
+			return frames.front()->state == State::READY;
+		});
+		if (frames.empty() || frames.front()->state != State::READY) return false;
+
+		frame.swap(frames.front()->pixels);
+		if (frames.front()->pixels.capacity() != 0) spare.push_back(std::move(frames.front()->pixels));
+		frames.pop_front();
+		lock.unlock();
+
+		spaceAvailable.notify_one();
+		return true;
+	}
+
+	/**
+	* run
+	* Workers take queued frames oldest first. With several workers frames can finish out of
+	* order; nextFrame still hands them out in order.
+	*/
+	void VideoFramePacker::run() {
+		for (;;) {
+			Frame *frame = nullptr;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				workAvailable.wait(lock, [&] {
+					if (stopping) return true;
+					for (auto &pending : frames) {
+						if (pending->state == State::QUEUED) {
+							frame = pending.get();
+							return true;
+						}
+					}
+					return false;
+				});
+				if (stopping) return;
+				frame->state = State::PACKING;
+			}
+
+			// frames are only removed once READY, so this one stays put while packed unlocked
+			frame->pixels.resize(static_cast<size_t>(width) * height * 3);
+			frame->packer.packPixels(0, frame->pixels.data(), static_cast<ptrdiff_t>(width) * 3);
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				frame->state = State::READY;
+			}
+			frameReady.notify_all();
+		}
+	}
+
+	bool VideoFramePacker::makeSequence(PatternSequence &patternSequence, Pattern::Color color, bool invertPattern, bool insertBlack) const {
+		if (_patternsPerFrame > maxPatternInSequence) return false;
+
+		patternSequence.clear();
+		for (size_t n = 0; n < _patternsPerFrame; n++) {
+			// same slots as PatternPacker fills for one image
+			size_t startBit = (bitDepth == 5) ? 6 * n + 1 : (bitDepth == 7) ? 8 * n + 1 : bitDepth * n;
+			auto triggerType = (n == 0) ? Pattern::TriggerType::EXTERNAL_POSITIVE : Pattern::TriggerType::NO_TRIGGER;
+			patternSequence.addPattern(color, triggerType, bitDepth, 0, static_cast<Pattern::BitIndex>(startBit), invertPattern, insertBlack);
+		}
+
+		return true;
+	}
+};
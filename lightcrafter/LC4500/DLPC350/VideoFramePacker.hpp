@@ -0,0 +1,90 @@
+#ifndef _LC4500_VIDEOFRAMEPACKER_H_
+#define _LC4500_VIDEOFRAMEPACKER_H_
+
+#include "PatternPacker.hpp"
+#include "PatternSequence.hpp"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace LC4500 {
+	/**
+	* VideoFramePacker
+	* Streams patterns of one bit depth into 24-bit video frames for PatternDisplayMode::EXTERNAL:
+	* each frame carries the bit planes the controller shows after one VSYNC, in Pattern::BitIndex
+	* order, so up to 24 binary patterns go out per frame without touching flash.
+	* Full frames are packed by worker threads and returned in order by nextFrame. Pattern data
+	* is not copied and must stay valid until its frame has been returned.
+	*/
+	class VideoFramePacker {
+	public:
+		// numThreads 0 = one per core; at most maxFramesInFlight frames are queued or being packed
+		VideoFramePacker(uint32_t width, uint32_t height, uint8_t bitDepth, size_t numThreads = 0, size_t maxFramesInFlight = 4);
+		virtual ~VideoFramePacker();
+
+		VideoFramePacker(const VideoFramePacker&) = delete;
+		VideoFramePacker& operator=(const VideoFramePacker&) = delete;
+
+		inline uint8_t getBitDepth() const { return bitDepth; }
+		inline size_t patternsPerFrame() const { return _patternsPerFrame; }
+
+		// as PatternPacker::addPlane / addPackedPlane; block while maxFramesInFlight frames are pending
+		bool addPlane(const uint8_t *data, size_t stride);
+		bool addPackedPlane(const uint8_t *data, size_t stride);
+
+		// queues the current frame even if not full, the unused bits stay dark
+		void flush();
+
+		// flushes and lets nextFrame return false once every frame has been returned
+		void close();
+
+		/*
+		* Blocks for the next frame: width * height B, G, R pixels, top row first, rows not padded
+		* (a top-down 24-bit DIB). The previous contents of `frame` are reused as a frame buffer.
+		* Returns false when closed and drained.
+		*/
+		bool nextFrame(std::vector<uint8_t> &frame);
+
+		/*
+		* Fills patternSequence with the patterns of one frame, for pattern trigger mode 0
+		* (PatternTriggerMode::MODE0): VSYNC triggers the first pattern and swaps the buffer, the
+		* others follow without trigger. The sequence repeats on every frame.
+		*/
+		bool makeSequence(PatternSequence &patternSequence, Pattern::Color color = Pattern::Color::WHITE,
+			bool invertPattern = false, bool insertBlack = true) const;
+
+	private:
+		enum class State : uint8_t { FILLING, QUEUED, PACKING, READY };
+
+		struct Frame {
+			PatternPacker packer;
+			std::vector<uint8_t> pixels;
+			State state;
+			Frame(uint32_t width, uint32_t height) : packer(width, height), state(State::FILLING) {}
+		};
+
+		bool add(const uint8_t *data, size_t stride, bool packed);
+		void queueCurrent(std::unique_lock<std::mutex> &lock);
+		void run();
+
+		uint32_t width, height;
+		uint8_t bitDepth;
+		size_t _patternsPerFrame;
+		size_t maxFramesInFlight;
+
+		std::deque<std::unique_ptr<Frame>> frames; // in output order, the last one may still be filling
+		std::vector<std::vector<uint8_t>> spare;   // frame buffers handed back by nextFrame
+		bool closed, stopping;
+
+		std::mutex mutex;
+		std::condition_variable workAvailable, frameReady, spaceAvailable;
+		std::vector<std::thread> workers;
+	};
+};
+
+#endif
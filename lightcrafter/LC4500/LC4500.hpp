@@ -3,6 +3,16 @@
 
 #include "DLPC350/DLPC350.hpp"
 #include "DLPC350/PatternSequence.hpp"
+#include "DLPC350/PatternSequenceOptimizer.hpp"
+#include "DLPC350/PatternPacker.hpp"
+#include "DLPC350/VideoFramePacker.hpp"
+#include "DLPC350/SequenceRenderer.hpp"
+#include "DLPC350/Memory.hpp"
+#include "DLPC350/I2C.hpp"
+#include "DLPC350/Flash.hpp"
+#include "DLPC350/FlashDevice.hpp"
+#include "DLPC350/PWMCapture.hpp"
+#include "DLPC350/ImageLoadBenchmark.hpp"
 #include "DLPC350/Transaction.hpp"
 #include "USB/USB.hpp"
 #include "Error.hpp"
@@ -37,8 +37,10 @@
 */
 
 #include <time.h>
+#include <string.h>
 #include "dlpc350_common.h"
 #include "dlpc350_error.h"
+#include "dlpc350_simd.h"
 
 #include "dlpc350_BMPParser.h"
 
@@ -64,6 +66,9 @@
 
 #define GET_LINE_BYTES(Image)	(ALIGN_BYTES_NEXT((Image)->Width * (Image)->BitDepth, 32)/8)
 
+/* BMP_StoreImage gathers the file into blocks of this size before calling PutData */
+#define BMP_WRITE_BLOCK_SIZE    (256 * 1024)
+
 /**************************** LOCAL TYPES ************************************/
 typedef struct
 {
@@ -80,6 +85,11 @@ typedef struct
 
 /********************* LOCAL FUNCTION PROTOTYPES *****************************/
 static ErrorCode_t BMP_ParseHeader(BMP_ImageHeader_t *Image, uint8 *Data, uint32 DataSize);
+static ErrorCode_t BMP_CheckBitDepth(const BMP_ImageHeader_t *Image);
+static uint32 *BMP_AllocPalette(const BMP_ImageHeader_t *Image);
+static void BMP_ConvertPalette(uint32 *Palette, uint32 PaletteSize, uint8 OutBitDepth);
+static const uint8 *BMP_ConvertLine(const BMP_ImageHeader_t *Image, const uint32 *Palette,
+                                    const uint8 *LineData, uint8 *LineOutput, uint8 OutBitDepth);
 /****************************** VARIABLES ************************************/
 
 /************************ FUNCTION DEFINITIONS*******************************/
@@ -111,12 +121,7 @@ ErrorCode_t BMP_ParseImage(BMP_DataFunc_t *GetData, void *DataParam,
     uint32 *Palette = NULL;
     uint32 LineWidth;
     uint32 OutLineWidth;
-    int Shift;
-    unsigned int PixelsPerByte;
-    unsigned int x;
     unsigned int y;
-    unsigned int i;
-    unsigned int j;
 
     ERR_BLOCK_BEGIN
     {
@@ -140,53 +145,23 @@ ErrorCode_t BMP_ParseImage(BMP_DataFunc_t *GetData, void *DataParam,
 
         ReadIndex = Image.PaletteOffset;
 
-        if(Image.BitDepth != 1 && Image.BitDepth != 2 && Image.BitDepth != 4 &&
-                Image.BitDepth != 8 && Image.BitDepth != 16 && Image.BitDepth != 24)
+        if(BMP_CheckBitDepth(&Image))
             ERR_THROW_MSG(Error = ERR_NOT_SUPPORTED, "Error un supported bit depth");
 
         if(Image.BitDepth <= 8)
         {
             if(Image.PixelOffset - ReadIndex < Image.PaletteSize * 4)
                 ERR_THROW_MSG(Error = ERR_FORMAT_ERROR, "BMP File format error");
-#if 1
-            Palette = (uint32 *)malloc(Image.PaletteSize * 4);
+
+            Palette = BMP_AllocPalette(&Image);
             if(Palette == NULL)
                 ERR_THROW_MSG(Error = ERR_OUT_OF_RESOURCE, "Unable to allocate memory for palette");
 
             if(GetData(DataParam, (uint8*)Palette, Image.PaletteSize * 4))
                 ERR_THROW_MSG(Error = FAIL, "Error while reading palette");
 
-            if(OutBitDepth == 16)
-            {
-                for(i = 0; i < Image.PaletteSize; i++)
-                {
-                    uint32 color = Palette[i];
-                    Palette[i] = ((color & 0x0000F8) >> 3) |
-                            ((color & 0x00FC00) >> 5) |
-                            ((color & 0xF80000) >> 8) ;
-                }
-            }
-            else if(OutBitDepth <= 8)
-            {
-                for(i = 0; i < Image.PaletteSize; i++)
-                {
-                    uint32 color = Palette[i];
-                    Palette[i] = (GET_BYTE0(color) |
-                                  GET_BYTE1(color) |
-                                  GET_BYTE2(color) ) >> (8 - OutBitDepth);
-                }
-            }
+            BMP_ConvertPalette(Palette, Image.PaletteSize, OutBitDepth);
 
-#else
-            int i;
-            for(i = 0; i < Image.PaletteSize; i++)
-            {
-                uint32 PixVal;
-                if(GetData(DataParam, (uint8*)&PixVal, 4))
-                    ERR_THROW_MSG(Error = FAIL, "Error while reading palette");
-                DEBUG_MSG("Palette %d: %08X\n", i, PixVal);
-            }
-#endif
             ReadIndex += Image.PaletteSize * 4;
         }
 
@@ -213,158 +188,169 @@ ErrorCode_t BMP_ParseImage(BMP_DataFunc_t *GetData, void *DataParam,
         if(LineOutput == NULL)
             ERR_THROW(Error = ERR_OUT_OF_RESOURCE);
 
-        if(Image.BitDepth <= 8)
+        for(y = Image.Height; y-- > 0;)
         {
-            Shift = 8 - Image.BitDepth;
-            PixelsPerByte = 8 / Image.BitDepth;
-            for(y = Image.Height; y-- > 0;)
-            {
-                if(GetData(DataParam, LineData, LineWidth))
-                    ERR_THROW_MSG(Error = FAIL, "Error while reading pixels");
+            const uint8 *Ptr;
 
-                if(OutBitDepth <= 8)
-                {
-                    for(x = 0, i = 0; i < LineWidth; i++)
-                    {
-                        uint8 PixData = LineData[i];
-                        for(j = 0; j < PixelsPerByte && x < Image.Width; j++, x++)
-                        {
-                            LineOutput[x] = Palette[PixData >> Shift];
-                            PixData <<= Image.BitDepth;
-                        }
-                    }
-                }
-                else if(OutBitDepth >= 24)
-                {
-                    for(x = 0, i = 0; i < LineWidth; i++)
-                    {
-                        uint8 PixData = LineData[i];
-                        for(j = 0; j < PixelsPerByte && x < OutLineWidth; j++)
-                        {
-                            uint32 Color = Palette[PixData >> Shift];
-                            LineOutput[x++] = GET_BYTE0(Color);
-                            LineOutput[x++] = GET_BYTE1(Color);
-                            LineOutput[x++] = GET_BYTE2(Color);
-                            PixData <<= Image.BitDepth;
-                        }
-                    }
-                }
-                else if(OutBitDepth == 16)
-                {
-                    for(x = 0, i = 0; i < LineWidth; i++)
-                    {
-                        uint8 PixData = LineData[i];
-                        for(j = 0; j < PixelsPerByte && x < OutLineWidth; j++)
-                        {
-                            uint32 Color = Palette[PixData >> Shift];
-                            LineOutput[x++] = GET_BYTE0(Color);
-                            LineOutput[x++] = GET_BYTE1(Color);
-                            PixData <<= Image.BitDepth;
-                        }
-                    }
-                }
+            if(GetData(DataParam, LineData, LineWidth))
+                ERR_THROW_MSG(Error = FAIL, "Error while reading pixels");
 
-                if(DrawPixels(DrawParam, 0, y, LineOutput, Image.Width))
-                    ERR_THROW_MSG(Error = FAIL, "Error while drawing pixel");
+            Ptr = BMP_ConvertLine(&Image, Palette, LineData, LineOutput, OutBitDepth);
 
-            }
+            if(DrawPixels(DrawParam, 0, y, (uint8 *)Ptr, Image.Width))
+                ERR_THROW_MSG(Error = FAIL, "Error while drawing pixel");
         }
-        else if(Image.BitDepth == 24)
-        {
-            Shift = 8 - OutBitDepth;
-
-            for(y = Image.Height; y-- > 0;)
-            {
-                if(GetData(DataParam, LineData, LineWidth))
-                    ERR_THROW_MSG(Error = FAIL, "Error while reading pixel");
+    }
+    ERR_BLOCK_END;
 
-                if(OutBitDepth <= 8)
-                {
-                    unsigned int x1;
-                    unsigned int x2;
-                    for(x1 = 0, x2 = 0; x1 < Image.Width; x1++, x2+=3)
-                    {
-                        LineData[x1] = (LineData[x2] | LineData[x2 + 1] |
-                                LineData[x2 + 2]) >> Shift;
-                    }
-                }
-                else if(OutBitDepth == 16)
-                {
-                    unsigned int x1;
-                    unsigned int x2;
-                    for(x1 = 0, x2 = 0; x1 < Image.Width; x1++, x2+=3)
-                    {
-                        uint32 Color = LineData[x2] | (LineData[x2 + 1] << 8) | (LineData[x2 + 2] << 16);
-                        ((uint16 *)LineData)[x1] = ((Color & 0xF8) >> 3) | ((Color & 0xFC00) >> 5) | ((Color & 0xF80000) >> 8);
-                    }
-                }
+    free(Palette);
+    free(LineData);
+    free(LineOutput);
 
-                if(DrawPixels(DrawParam, 0, y, LineData, Image.Width))
-                    ERR_THROW_MSG(Error = FAIL, "Error while drawing pixel");
-            }
-        }
-        else if(Image.BitDepth == 16)
-        {
-            uint8 *Ptr;
+    return Error;
+}
 
-            if(OutBitDepth == 16)
-                Ptr = LineData;
-            else
-                Ptr = LineOutput;
+/**
+*  This function locates the pixel rows and the palette of an uncompressed BMP
+*  held in memory (a loaded or memory mapped file) without copying them
+*
+*  @param Data - The BMP file contents
+*  @param DataSize - Size of Data in bytes
+*  @param View - Filled with the image format and pointers into Data
+*
+*  return SUCCESS, ERR_INVALID_PARAM, ERR_FORMAT_ERROR, ERR_NOT_SUPPORTED
+*/
+ErrorCode_t BMP_ViewImage(const uint8 *Data, uint32 DataSize, BMP_View_t *View)
+{
+    ErrorCode_t Error = SUCCESS;
+    BMP_ImageHeader_t Image;
+    uint32 LineWidth;
 
-            for(y = Image.Height; y-- > 0;)
-            {
-                if(GetData(DataParam, LineData, LineWidth))
-                    ERR_THROW_MSG(Error = FAIL, "Error while reading pixel");
+    ERR_BLOCK_BEGIN
+    {
+        if(View == NULL)
+            ERR_THROW(Error = ERR_INVALID_PARAM);
 
-                if(OutBitDepth <= 8)
-                {
-                    unsigned int x1;
-                    for(x1 = 0; x1 < Image.Width; x1++)
-                    {
-                        uint16 color = ((uint16 *)LineData)[x1];
-                        color = ((color << 3) & 0xF8) | ((color >> 3) & 0xFC) | ((color >> 8) & 0xF8);
-                        Ptr[x1] = color & 0xFF;
-                    }
-                }
-                else if(OutBitDepth >= 24)
-                {
-                    unsigned int x1;
-                    unsigned int x2;
+        TRY(BMP_ParseHeader(&Image, (uint8 *)Data, DataSize));
 
-                    for(x1 = x2 = 0; x1 < Image.Width; x1++, x2 += 3)
-                    {
-                        uint16 color = ((uint16 *)LineData)[x1];
+        if(BMP_CheckBitDepth(&Image))
+            ERR_THROW_MSG(Error = ERR_NOT_SUPPORTED, "Error un supported bit depth");
 
-                        Ptr[x2 + 0] = (color << 3) & 0xF8;
-                        Ptr[x2 + 1] = (color >> 3) & 0xFC;
-                        Ptr[x2 + 2] = (color >> 8) & 0xF8;
-                    }
-                }
+        if(Image.BitDepth <= 8 && (unsigned long long)Image.PaletteOffset +
+                (unsigned long long)Image.PaletteSize * 4 > Image.PixelOffset)
+            ERR_THROW_MSG(Error = ERR_FORMAT_ERROR, "BMP File format error");
 
-                if(DrawPixels(DrawParam, 0, y, Ptr, Image.Width))
-                    ERR_THROW_MSG(Error = FAIL, "Error while drawing pixel");
-            }
-        }
+        LineWidth = GET_LINE_BYTES(&Image);
+        if(LineWidth > 0x7FFFFFFF || (unsigned long long)Image.PixelOffset +
+                (unsigned long long)LineWidth * Image.Height > DataSize)
+            ERR_THROW_MSG(Error = ERR_FORMAT_ERROR, "BMP pixel data truncated");
+
+        View->Image.Width = Image.Width;
+        View->Image.Height = Image.Height;
+        View->Image.BitDepth = (uint8)Image.BitDepth;
+        View->Image.NumColors = Image.BitDepth <= 8 ? (uint16)Image.PaletteSize : 0;
+        View->Stride = -(int)LineWidth;
+        View->Pixels = Data + Image.PixelOffset;
+        if(Image.Height > 0)
+            View->Pixels += (unsigned long long)LineWidth * (Image.Height - 1);
+        View->Palette = Image.BitDepth <= 8 ? Data + Image.PaletteOffset : NULL;
     }
     ERR_BLOCK_END;
 
-    free(Palette);
-    free(LineData);
-    free(LineOutput);
-
     return Error;
 }
 
 /**
-* This function initializes the image structure for a new image
-* @param Image - Image structure to be filled
-* @param Width - Width of the image
-* @param Height - Height of the image
-* @param BitDepth - Bit depth of the image
+*  This function parses a BMP image held in memory. When the stored pixels are
+*  already in the requested format (24 bpp to 24 bpp, or 8 bpp with a gray
+*  ramp palette to 8 bpp) the whole pixel block is passed to DrawBlock without
+*  copying. Otherwise, or when DrawBlock is NULL, the rows are passed to
+*  DrawPixels bottom-up as BMP_ParseImage does; unconverted rows point into
+*  Data and must not be modified.
+*
+*  @param Data - The BMP file contents
+*  @param DataSize - Size of Data in bytes
+*  @param DrawPixels - Function pointer for drawing a row of pixels
+*  @param DrawBlock - Function pointer for drawing the whole image, may be NULL
+*  @param DrawParam - Parameter to be passed for DrawPixels and DrawBlock
+*  @param OutBitDepth - Requested pixel format as in BMP_ParseImage
 *
 *  return SUCCESS, FAIL
 */
+ErrorCode_t BMP_ParseImageBuffer(const uint8 *Data, uint32 DataSize,
+                                 BMP_PixelFunc_t *DrawPixels, BMP_BlockFunc_t *DrawBlock,
+                                 void *DrawParam, uint8 OutBitDepth)
+{
+    ErrorCode_t Error = SUCCESS;
+    BMP_View_t View;
+    BMP_ImageHeader_t Image;
+    uint8 *LineOutput = NULL;
+    uint32 *Palette = NULL;
+    BOOL Direct;
+    unsigned int y;
+    unsigned int i;
+
+    TRY(BMP_ViewImage(Data, DataSize, &View));
+
+    memset(&Image, 0, sizeof(Image));
+    Image.Width = View.Image.Width;
+    Image.Height = View.Image.Height;
+    Image.BitDepth = View.Image.BitDepth;
+    Image.PaletteSize = View.Image.NumColors;
+
+    Direct = View.Image.BitDepth == 24 && OutBitDepth >= 24;
+
+    if(View.Image.BitDepth <= 8)
+    {
+        Palette = BMP_AllocPalette(&Image);
+        if(Palette == NULL)
+            ERR_THROW_MSG(ERR_OUT_OF_RESOURCE, "Unable to allocate memory for palette");
+
+        memcpy(Palette, View.Palette, Image.PaletteSize * 4);
+        BMP_ConvertPalette(Palette, Image.PaletteSize, OutBitDepth);
+
+        /* Indices of a gray ramp palette are the output pixels */
+        if(View.Image.BitDepth == 8 && OutBitDepth == 8)
+        {
+            for(i = 0; i < 256 && Palette[i] == i; i++)
+                ;
+            Direct = (i == 256);
+        }
+    }
+
+    if(Direct && DrawBlock != NULL)
+    {
+        if(DrawBlock(DrawParam, View.Pixels, View.Stride, View.Image.Width, View.Image.Height))
+            Error = FAIL;
+    }
+    else
+    {
+        if(!Direct)
+        {
+            LineOutput = (uint8 *)malloc(OutBitDepth >= 24 ? 3 * Image.Width :
+                                         OutBitDepth == 16 ? 2 * Image.Width : Image.Width);
+            if(LineOutput == NULL)
+                Error = ERR_OUT_OF_RESOURCE;
+        }
+
+        for(y = Image.Height; Error == SUCCESS && y-- > 0;)
+        {
+            const uint8 *Row = View.Pixels + (long long)View.Stride * y;
+
+            if(!Direct)
+                Row = BMP_ConvertLine(&Image, Palette, Row, LineOutput, OutBitDepth);
+
+            if(DrawPixels(DrawParam, 0, y, (uint8 *)Row, Image.Width))
+                Error = FAIL;
+        }
+    }
+
+    free(Palette);
+    free(LineOutput);
+
+    return Error;
+}
+
 ErrorCode_t BMP_InitImage(BMP_Image_t *Image, uint32 Width, uint32 Height, uint8 BitDepth)
 {
     if(Image == NULL)
@@ -392,36 +378,156 @@ ErrorCode_t BMP_InitImage(BMP_Image_t *Image, uint32 Width, uint32 Height, uint8
     return SUCCESS;
 }
 
-static ErrorCode_t BMP_PutData(BMP_DataFunc_t *PutData, void *DataParam, uint32 Value, uint8 Size)
+/**
+* This function returns the BMP file size fo the given image
+* @param Image - Image structure
+*
+*  return Image file size
+*/
+uint32 BMP_ImageSize(BMP_Image_t *Image)
+{
+    uint32 PixOffset = Image->NumColors * 4 + BMP_FILE_HEADER_SIZE + BMP_DIB_HEADER_SIZE;
+    uint32 DataSize = GET_LINE_BYTES(Image) * Image->Height;
+    uint32 FileSize =  DataSize + PixOffset;
+
+    return FileSize;
+}
+
+/* Collects file data into blocks of at least BMP_WRITE_BLOCK_SIZE bytes for PutData */
+typedef struct
+{
+    BMP_DataFunc_t *PutData;
+    void *DataParam;
+    uint8 *Block;
+    uint32 Size;
+    uint32 Used;
+} BMP_Writer_t;
+
+static void BMP_StoreLE(uint8 *Data, uint32 Value, uint8 Size)
 {
-    uint8 Data[4];
     uint8 i;
     for(i = 0; i < Size; i++)
     {
         Data[i] = Value & 0xFF;
         Value >>= 8;
     }
-    return PutData(DataParam, Data, Size);
+}
+
+static ErrorCode_t BMP_WriterFlush(BMP_Writer_t *Writer)
+{
+    uint32 Used = Writer->Used;
+
+    Writer->Used = 0;
+    if(Used == 0)
+        return SUCCESS;
+
+    return Writer->PutData(Writer->DataParam, Writer->Block, Used);
+}
+
+/* Room for Size bytes in the block, writing out what it holds first if needed; NULL on write error */
+static uint8 *BMP_WriterReserve(BMP_Writer_t *Writer, uint32 Size)
+{
+    uint8 *Data;
+
+    if(Writer->Size - Writer->Used < Size && BMP_WriterFlush(Writer) != SUCCESS)
+        return NULL;
+
+    Data = Writer->Block + Writer->Used;
+    Writer->Used += Size;
+    return Data;
 }
 
 /**
-* This function returns the BMP file size fo the given image
-* @param Image - Image structure
+*  Allocates the writer block and puts the file header, the DIB header and the
+*  palette or bit fields into it
 *
-*  return Image file size
+*  return SUCCESS, ERR_OUT_OF_RESOURCE
 */
-uint32 BMP_ImageSize(BMP_Image_t *Image)
+static ErrorCode_t BMP_WriterBegin(BMP_Writer_t *Writer, const BMP_Image_t *Image,
+                                   BMP_DataFunc_t *PutData, void *DataParam)
 {
-    uint32 PixOffset = Image->NumColors * 4 + BMP_FILE_HEADER_SIZE + BMP_DIB_HEADER_SIZE;
+    uint32 HeaderSize = Image->BitDepth == 16 ? BMP_DIB_HEADER_SIZE1 : BMP_DIB_HEADER_SIZE;
+    uint32 PixOffset = Image->NumColors * 4 + BMP_FILE_HEADER_SIZE + HeaderSize;
     uint32 DataSize = GET_LINE_BYTES(Image) * Image->Height;
-    uint32 FileSize =  DataSize + PixOffset;
+    uint8 *Header;
+    uint32 i;
+
+    Writer->PutData = PutData;
+    Writer->DataParam = DataParam;
+    Writer->Used = 0;
+    Writer->Size = MAX(MAX(BMP_WRITE_BLOCK_SIZE, PixOffset), GET_LINE_BYTES(Image));
+    Writer->Block = (uint8 *)malloc(Writer->Size);
+    if(Writer->Block == NULL)
+        return ERR_OUT_OF_RESOURCE;
+
+    Header = BMP_WriterReserve(Writer, PixOffset);
+    memset(Header, 0, PixOffset);
+
+    BMP_StoreLE(Header + 0, BMP_SIGNATURE, 2);
+    BMP_StoreLE(Header + 2, DataSize + PixOffset, 4);
+    BMP_StoreLE(Header + 10, PixOffset, 4);
+    BMP_StoreLE(Header + 14, HeaderSize, 4);
+    BMP_StoreLE(Header + 18, Image->Width, 4);
+    BMP_StoreLE(Header + 22, Image->Height, 4);
+    BMP_StoreLE(Header + 26, 1, 2); /* Number of color planes */
+    BMP_StoreLE(Header + 28, Image->BitDepth, 2);
+    BMP_StoreLE(Header + 30, Image->BitDepth == 16 ? 3 : 0, 4); /* Compression = None */
+    BMP_StoreLE(Header + 34, DataSize, 4);
+    BMP_StoreLE(Header + 38, 2835, 4); /* H Res pix/meter */
+    BMP_StoreLE(Header + 42, 2835, 4); /* V Res pix/meter */
+    BMP_StoreLE(Header + 46, Image->NumColors, 4); /* Palette Size */
+                                                   /* Important colors = All */
+    if(Image->BitDepth == 16)
+    {
+        BMP_StoreLE(Header + 54, 0xF800, 4);
+        BMP_StoreLE(Header + 58, 0x07E0, 4);
+        BMP_StoreLE(Header + 62, 0x001F, 4);
+        BMP_StoreLE(Header + 70, 0x57696E20, 4);
+    }
 
-    return FileSize;
+    for(i = 0; i < Image->NumColors; i++)
+    {
+        uint8 Val = (0xFF * i)/(Image->NumColors-1);
+        BMP_StoreLE(Header + BMP_FILE_HEADER_SIZE + HeaderSize + i * 4, MAKE_WORD32(255, Val, Val, Val), 4);
+    }
+
+    return SUCCESS;
+}
+
+/* One pixel per byte to BitDepth bits per pixel, first pixel in the most significant bits */
+static void BMP_PackLine(const BMP_Image_t *Image, const uint8 *Pixels, uint8 *LineOut)
+{
+    uint32 LineWidth = GET_LINE_BYTES(Image);
+    uint32 PixelsPerByte = 8/Image->BitDepth;
+    uint8 Mask = (uint8)GEN_BIT_MASK(0, Image->BitDepth);
+    uint32 i, j, x;
+
+    if(Image->BitDepth == 8)
+    {
+        memcpy(LineOut, Pixels, Image->Width);
+        memset(LineOut + Image->Width, 0, LineWidth - Image->Width);
+        return;
+    }
+
+    for(i = 0, x = 0; x < LineWidth; x++)
+    {
+        uint8 Byte = 0;
+        for(j = 0; j < PixelsPerByte; j++)
+        {
+            Byte <<= Image->BitDepth;
+            if(i < Image->Width)
+            {
+                Byte |= Pixels[i++] & Mask;
+            }
+        }
+        LineOut[x] = Byte;
+    }
 }
 
 /**
 *  This function stores the image formation received from GetPixels function and
-*  stores it in BMP file format using PutData function
+*  stores it in BMP file format using PutData function. The file is gathered into
+*  large blocks, so PutData is called a few times per image rather than per row.
 *
 *  @param Image - Image structure
 *  @param PutData - Function pointer for store the BMP file data
@@ -429,145 +535,124 @@ uint32 BMP_ImageSize(BMP_Image_t *Image)
 *  @param GetPixels - Function pointer to get the image pixels
 *  @param PixelParam - Parameter to be passed for GetPixels function
 *
-*  return SUCCESS, FAIL
+*  return SUCCESS, FAIL, ERR_OUT_OF_RESOURCE
 */
 ErrorCode_t BMP_StoreImage(BMP_Image_t *Image, BMP_DataFunc_t *PutData, void *DataParam,
                            BMP_PixelFunc_t *GetPixels, void *PixelParam)
 {
     ErrorCode_t Error = SUCCESS;
-    int HeaderSize = Image->BitDepth == 16 ? BMP_DIB_HEADER_SIZE1 : BMP_DIB_HEADER_SIZE;
-    uint32 PixOffset = Image->NumColors * 4 + BMP_FILE_HEADER_SIZE + HeaderSize;
-    uint32 DataSize = GET_LINE_BYTES(Image) * Image->Height;
-    uint32 FileSize =  DataSize + PixOffset;
+    BMP_Writer_t Writer;
+    uint32 LineWidth = GET_LINE_BYTES(Image);
+    uint32 PixelBytes = Image->Width * Image->BitDepth / 8;
     uint8 *Buffer = NULL;
-    uint8 *LineOut = NULL;
-    unsigned int x;
-    unsigned int y;
-    unsigned i;
-    unsigned j;
-    unsigned Mask;
-    unsigned LineWidth;
-    unsigned PixelsPerByte;
+    uint8 *LineOut;
+    uint32 y;
 
-    ERR_BLOCK_BEGIN
+    TRY(BMP_WriterBegin(&Writer, Image, PutData, DataParam));
+
+    if(Image->BitDepth <= 8)
     {
-        if(BMP_PutData(PutData, DataParam, BMP_SIGNATURE, 2))
-            ERR_THROW(Error = FAIL);
-        if(BMP_PutData(PutData, DataParam, FileSize, 4))
-            ERR_THROW(Error = FAIL);
-        if(BMP_PutData(PutData, DataParam, 0, 4)) /* Reserved */
-            ERR_THROW(Error = FAIL);
-        if(BMP_PutData(PutData, DataParam, PixOffset, 4))
-            ERR_THROW(Error = FAIL);
-        if(BMP_PutData(PutData, DataParam, HeaderSize, 4))
-            ERR_THROW(Error = FAIL);
-        if(BMP_PutData(PutData, DataParam, Image->Width, 4))
-            ERR_THROW(Error = FAIL);
-        if(BMP_PutData(PutData, DataParam, Image->Height, 4))
-            ERR_THROW(Error = FAIL);
-        if(BMP_PutData(PutData, DataParam, 1, 2)) /* Number of color planes */
-            ERR_THROW(Error = FAIL);
-        if(BMP_PutData(PutData, DataParam, Image->BitDepth, 2))
-            ERR_THROW(Error = FAIL);
-        if(BMP_PutData(PutData, DataParam, Image->BitDepth == 16 ? 3 : 0, 4)) /* Compression = None */
-            ERR_THROW(Error = FAIL);
-        if(BMP_PutData(PutData, DataParam, DataSize, 4))
-            ERR_THROW(Error = FAIL);
-        if(BMP_PutData(PutData, DataParam, 2835, 4)) /* H Res pix/meter */
-            ERR_THROW(Error = FAIL);
-        if(BMP_PutData(PutData, DataParam, 2835, 4)) /* V Res pix/meter */
-            ERR_THROW(Error = FAIL);
-        if(BMP_PutData(PutData, DataParam, Image->NumColors, 4)) /* Palette Size */
-            ERR_THROW(Error = FAIL);
-        if(BMP_PutData(PutData, DataParam, 0, 4)) /* Important colors = All */
-            ERR_THROW(Error = FAIL);
+        Buffer = (uint8 *)malloc(Image->Width);
+        if(Buffer == NULL)
+            Error = ERR_OUT_OF_RESOURCE;
+    }
 
-        for(i = 0; i < Image->NumColors; i++)
+    /* rows go straight into the block, bottom row first */
+    for(y = Image->Height; Error == SUCCESS && y-- > 0;)
+    {
+        LineOut = BMP_WriterReserve(&Writer, LineWidth);
+        if(LineOut == NULL)
         {
-            uint8 Val = (0xFF * i)/(Image->NumColors-1);
-            uint32 Color = MAKE_WORD32(255, Val, Val, Val);
-
-            if(BMP_PutData(PutData, DataParam, Color, 4))
-                ERR_THROW(Error = FAIL);
+            Error = FAIL;
+            break;
         }
 
-        if(Image->BitDepth == 16)
+        if(Image->BitDepth <= 8)
         {
-            if(BMP_PutData(PutData, DataParam, 0xF800, 4))
-                ERR_THROW(Error = FAIL);
-
-            if(BMP_PutData(PutData, DataParam, 0x07E0, 4))
-                ERR_THROW(Error = FAIL);
-
-            if(BMP_PutData(PutData, DataParam, 0x001F, 4))
-                ERR_THROW(Error = FAIL);
-
-            if(BMP_PutData(PutData, DataParam, 0, 4))
-                ERR_THROW(Error = FAIL);
-
-            if(BMP_PutData(PutData, DataParam, 0x57696E20, 4))
-                ERR_THROW(Error = FAIL);
-
-            for(i = 0; i < 12; i++)
-            {
-                if(BMP_PutData(PutData, DataParam, 0, 4))
-                    ERR_THROW(Error = FAIL);
-            }
+            if(GetPixels(PixelParam, 0, y, Buffer, Image->Width))
+                Error = FAIL;
+            else
+                BMP_PackLine(Image, Buffer, LineOut);
         }
-
-        if(Image->BitDepth <= 8)
+        else
         {
-            Buffer = (uint8 *)malloc(Image->Width);
-            if(Buffer == NULL)
-                ERR_THROW(Error = ERR_OUT_OF_RESOURCE);
+            if(GetPixels(PixelParam, 0, y, LineOut, Image->Width))
+                Error = FAIL;
+            memset(LineOut + PixelBytes, 0, LineWidth - PixelBytes);
         }
+    }
 
-        Mask = GEN_BIT_MASK(0, Image->BitDepth);
-        LineWidth = GET_LINE_BYTES(Image);
-        LineOut = (uint8 *)malloc(LineWidth);
-        if(LineOut == NULL)
-            ERR_THROW(Error = ERR_OUT_OF_RESOURCE);
+    if(Error == SUCCESS)
+        Error = BMP_WriterFlush(&Writer);
+
+    free(Writer.Block);
+    free(Buffer);
+
+    return Error;
+}
+
+/**
+*  Same as BMP_StoreImage, but the pixels come from a buffer: one byte per pixel up to
+*  8 bpp, 2 or 3 bytes per pixel (as stored in the file) for 16 and 24 bpp. When the
+*  buffer already has the file layout (Stride = -line size) the pixel data is passed to
+*  PutData in one call without copying, row padding included as found.
+*
+*  @param Image - Image structure
+*  @param PutData - Function pointer for store the BMP file data
+*  @param DataParam - Parameter to be passed for PutData function
+*  @param Pixels - Top image row
+*  @param Stride - Bytes from one row to the row below it, negative for bottom-up buffers
+*
+*  return SUCCESS, FAIL, ERR_OUT_OF_RESOURCE, ERR_INVALID_PARAM
+*/
+ErrorCode_t BMP_StoreImageBuffer(BMP_Image_t *Image, BMP_DataFunc_t *PutData, void *DataParam,
+                                 const uint8 *Pixels, int Stride)
+{
+    ErrorCode_t Error = SUCCESS;
+    BMP_Writer_t Writer;
+    uint32 LineWidth = GET_LINE_BYTES(Image);
+    uint32 PixelBytes = Image->Width * Image->BitDepth / 8;
+    uint8 *LineOut;
+    uint32 y;
 
+    if(Pixels == NULL)
+        return ERR_INVALID_PARAM;
 
-        PixelsPerByte = 8/Image->BitDepth;
+    TRY(BMP_WriterBegin(&Writer, Image, PutData, DataParam));
 
-        for(y = Image->Height; y-- > 0;)
+    if(Image->BitDepth > 8 && Stride == -(int)LineWidth && Image->Height > 0)
+    {
+        Error = BMP_WriterFlush(&Writer);
+        if(Error == SUCCESS)
+            Error = PutData(DataParam, (uint8 *)Pixels + (int)(Image->Height - 1) * Stride, LineWidth * Image->Height);
+    }
+    else
+    {
+        for(y = Image->Height; Error == SUCCESS && y-- > 0;)
         {
-            if(Image->BitDepth <= 8)
-            {
-                if(GetPixels(PixelParam, 0, y, Buffer, Image->Width))
-                    ERR_THROW(Error = FAIL);
+            const uint8 *Row = Pixels + (int)y * Stride;
 
-                for(i = 0, x = 0; x < LineWidth; x++)
-                {
-                    uint8 Byte = 0;
-                    for(j = 0; j < PixelsPerByte; j++)
-                    {
-                        Byte <<= Image->BitDepth;
-                        if(i < Image->Width)
-                        {
-                            Byte |= Buffer[i++] & Mask;
-                        }
-                    }
-                    LineOut[x] = Byte;
-                }
-                if(PutData(DataParam, LineOut, LineWidth))
-                    ERR_THROW_MSG(Error = FAIL, "Error while drawing pixel");
+            LineOut = BMP_WriterReserve(&Writer, LineWidth);
+            if(LineOut == NULL)
+            {
+                Error = FAIL;
+                break;
             }
+
+            if(Image->BitDepth <= 8)
+                BMP_PackLine(Image, Row, LineOut);
             else
             {
-                if(GetPixels(PixelParam, 0, y, LineOut, Image->Width))
-                    ERR_THROW(Error = FAIL);
-
-                if(PutData(DataParam, LineOut, LineWidth))
-                    ERR_THROW_MSG(Error = FAIL, "Error while drawing pixel");
+                memcpy(LineOut, Row, PixelBytes);
+                memset(LineOut + PixelBytes, 0, LineWidth - PixelBytes);
             }
         }
+
+        if(Error == SUCCESS)
+            Error = BMP_WriterFlush(&Writer);
     }
-    ERR_BLOCK_END;
 
-    free(LineOut);
-    free(Buffer);
+    free(Writer.Block);
 
     return Error;
 }
@@ -639,3 +724,253 @@ static ErrorCode_t BMP_ParseHeader(BMP_ImageHeader_t *Image, uint8 *Data, uint32
 
     return Error;
 }
+
+/**
+*  This function checks that the pixel format is one the parser converts
+*
+*  @param Image - The parsed BMP header
+*
+*  return SUCCESS, ERR_NOT_SUPPORTED
+*/
+static ErrorCode_t BMP_CheckBitDepth(const BMP_ImageHeader_t *Image)
+{
+    if(Image->BitDepth != 1 && Image->BitDepth != 2 && Image->BitDepth != 4 &&
+            Image->BitDepth != 8 && Image->BitDepth != 16 && Image->BitDepth != 24)
+        return ERR_NOT_SUPPORTED;
+
+    return SUCCESS;
+}
+
+/**
+*  This function allocates a zero filled palette with an entry for every
+*  index the pixel format can hold, even if the file stores fewer colors
+*
+*  @param Image - The parsed BMP header
+*
+*  return The palette, NULL if out of memory
+*/
+static uint32 *BMP_AllocPalette(const BMP_ImageHeader_t *Image)
+{
+    uint32 Entries = MAX(Image->PaletteSize, (uint32)1 << Image->BitDepth);
+
+    return (uint32 *)calloc(Entries, 4);
+}
+
+/**
+*  This function converts the palette read from the file to the output pixel format
+*
+*  @param Palette - The palette entries, converted in place
+*  @param PaletteSize - Number of entries stored in the file
+*  @param OutBitDepth - Output pixel format
+*/
+static void BMP_ConvertPalette(uint32 *Palette, uint32 PaletteSize, uint8 OutBitDepth)
+{
+    uint32 i;
+
+    if(OutBitDepth == 16)
+    {
+        for(i = 0; i < PaletteSize; i++)
+        {
+            uint32 color = Palette[i];
+            Palette[i] = ((color & 0x0000F8) >> 3) |
+                    ((color & 0x00FC00) >> 5) |
+                    ((color & 0xF80000) >> 8) ;
+        }
+    }
+    else if(OutBitDepth <= 8)
+    {
+        for(i = 0; i < PaletteSize; i++)
+        {
+            uint32 color = Palette[i];
+            Palette[i] = (GET_BYTE0(color) |
+                          GET_BYTE1(color) |
+                          GET_BYTE2(color) ) >> (8 - OutBitDepth);
+        }
+    }
+}
+
+/**
+*  This function expands 8 bpp palette indices to 24 bpp pixels. Each entry
+*  is stored as a whole word 3 bytes after the previous one, the next pixel
+*  overwrites the reserved byte.
+*
+*  @param Index - Palette indices
+*  @param Palette - 256 palette entries
+*  @param Output - 3 * Count bytes of pixels
+*  @param Count - Number of pixels
+*/
+static void BMP_ExpandPalette24(const uint8 *Index, const uint32 *Palette, uint8 *Output, uint32 Count)
+{
+    uint32 x;
+
+    if(Count == 0)
+        return;
+
+    for(x = 0; x + 1 < Count; x++)
+        memcpy(Output + 3 * x, &Palette[Index[x]], 4);
+
+    memcpy(Output + 3 * x, &Palette[Index[x]], 3);
+}
+
+#if DLPC350_SIMD_X86
+/**
+*  AVX2 version of BMP_ExpandPalette24, gathers 8 entries at a time and packs
+*  them to 24 bytes
+*/
+DLPC350_TARGET("avx2")
+static void BMP_ExpandPalette24AVX2(const uint8 *Index, const uint32 *Palette, uint8 *Output, uint32 Count)
+{
+    const __m256i Pack = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                                          0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    const __m256i Join = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+    uint32 x;
+
+    for(x = 0; x + 8 <= Count; x += 8)
+    {
+        __m256i Idx = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(Index + x)));
+        __m256i Color = _mm256_i32gather_epi32((const int *)Palette, Idx, 4);
+
+        Color = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(Color, Pack), Join);
+        _mm_storeu_si128((__m128i *)(Output + 3 * x), _mm256_castsi256_si128(Color));
+        _mm_storel_epi64((__m128i *)(Output + 3 * x + 16), _mm256_extracti128_si256(Color, 1));
+    }
+
+    BMP_ExpandPalette24(Index + x, Palette, Output + 3 * x, Count - x);
+}
+#endif
+
+/**
+*  This function converts one stored row to the output pixel format
+*
+*  @param Image - The parsed BMP header
+*  @param Palette - Converted palette for BitDepth <= 8
+*  @param LineData - The stored row
+*  @param LineOutput - Row buffer for the converted pixels
+*  @param OutBitDepth - Output pixel format
+*
+*  return LineData if it is already in the output format, LineOutput otherwise
+*/
+static const uint8 *BMP_ConvertLine(const BMP_ImageHeader_t *Image, const uint32 *Palette,
+                                    const uint8 *LineData, uint8 *LineOutput, uint8 OutBitDepth)
+{
+    uint32 LineWidth = GET_LINE_BYTES(Image);
+    unsigned int x;
+    unsigned int i;
+    unsigned int j;
+
+    if(Image->BitDepth == 8 && OutBitDepth >= 24)
+    {
+#if DLPC350_SIMD_X86
+        if(DLPC350_CpuFeatures() & CPU_FEATURE_AVX2)
+            BMP_ExpandPalette24AVX2(LineData, Palette, LineOutput, Image->Width);
+        else
+#endif
+        BMP_ExpandPalette24(LineData, Palette, LineOutput, Image->Width);
+    }
+    else if(Image->BitDepth == 8 && OutBitDepth <= 8)
+    {
+        for(x = 0; x < Image->Width; x++)
+            LineOutput[x] = Palette[LineData[x]];
+    }
+    else if(Image->BitDepth <= 8)
+    {
+        int Shift = 8 - Image->BitDepth;
+        unsigned int PixelsPerByte = 8 / Image->BitDepth;
+        uint32 OutLineWidth = (OutBitDepth >= 24 ? 3 : 2) * Image->Width;
+
+        if(OutBitDepth <= 8)
+        {
+            for(x = 0, i = 0; i < LineWidth; i++)
+            {
+                uint8 PixData = LineData[i];
+                for(j = 0; j < PixelsPerByte && x < Image->Width; j++, x++)
+                {
+                    LineOutput[x] = Palette[PixData >> Shift];
+                    PixData <<= Image->BitDepth;
+                }
+            }
+        }
+        else if(OutBitDepth >= 24)
+        {
+            for(x = 0, i = 0; i < LineWidth; i++)
+            {
+                uint8 PixData = LineData[i];
+                for(j = 0; j < PixelsPerByte && x < OutLineWidth; j++)
+                {
+                    uint32 Color = Palette[PixData >> Shift];
+                    LineOutput[x++] = GET_BYTE0(Color);
+                    LineOutput[x++] = GET_BYTE1(Color);
+                    LineOutput[x++] = GET_BYTE2(Color);
+                    PixData <<= Image->BitDepth;
+                }
+            }
+        }
+        else if(OutBitDepth == 16)
+        {
+            for(x = 0, i = 0; i < LineWidth; i++)
+            {
+                uint8 PixData = LineData[i];
+                for(j = 0; j < PixelsPerByte && x < OutLineWidth; j++)
+                {
+                    uint32 Color = Palette[PixData >> Shift];
+                    LineOutput[x++] = GET_BYTE0(Color);
+                    LineOutput[x++] = GET_BYTE1(Color);
+                    PixData <<= Image->BitDepth;
+                }
+            }
+        }
+    }
+    else if(Image->BitDepth == 24)
+    {
+        int Shift = 8 - OutBitDepth;
+        unsigned int x2;
+
+        if(OutBitDepth >= 24)
+            return LineData;
+
+        if(OutBitDepth <= 8)
+        {
+            for(x = 0, x2 = 0; x < Image->Width; x++, x2 += 3)
+            {
+                LineOutput[x] = (LineData[x2] | LineData[x2 + 1] |
+                        LineData[x2 + 2]) >> Shift;
+            }
+        }
+        else if(OutBitDepth == 16)
+        {
+            for(x = 0, x2 = 0; x < Image->Width; x++, x2 += 3)
+            {
+                uint32 Color = LineData[x2] | (LineData[x2 + 1] << 8) | (LineData[x2 + 2] << 16);
+                uint16 Pixel = ((Color & 0xF8) >> 3) | ((Color & 0xFC00) >> 5) | ((Color & 0xF80000) >> 8);
+                memcpy(LineOutput + 2 * x, &Pixel, 2);
+            }
+        }
+    }
+    else if(Image->BitDepth == 16)
+    {
+        unsigned int x2;
+
+        if(OutBitDepth == 16)
+            return LineData;
+
+        for(x = 0, x2 = 0; x < Image->Width; x++, x2 += 3)
+        {
+            uint16 color;
+            memcpy(&color, LineData + 2 * x, 2);
+
+            if(OutBitDepth <= 8)
+            {
+                color = ((color << 3) & 0xF8) | ((color >> 3) & 0xFC) | ((color >> 8) & 0xF8);
+                LineOutput[x] = color & 0xFF;
+            }
+            else if(OutBitDepth >= 24)
+            {
+                LineOutput[x2 + 0] = (color << 3) & 0xF8;
+                LineOutput[x2 + 1] = (color >> 3) & 0xFC;
+                LineOutput[x2 + 2] = (color >> 8) & 0xF8;
+            }
+        }
+    }
+
+    return LineOutput;
+}
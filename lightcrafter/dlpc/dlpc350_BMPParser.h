@@ -57,16 +57,38 @@ typedef struct
 typedef ErrorCode_t (BMP_DataFunc_t)(void *Param, uint8 *Data, uint32 Size);
 typedef ErrorCode_t (BMP_PixelFunc_t)(void *Param, uint32 X, uint32 Y, 
                                       uint8 *PixValue, uint32 Count);
+/* Whole pixel block: Pixels is the top image row, Stride the byte offset from one
+ * row to the row below it (negative for bottom-up files) */
+typedef ErrorCode_t (BMP_BlockFunc_t)(void *Param, const uint8 *Pixels, int Stride,
+                                      uint32 Width, uint32 Height);
+
+/* Uncompressed BMP held in memory, pointing into the caller's buffer */
+typedef struct
+{
+    BMP_Image_t Image;
+    const uint8 *Pixels;    /* Top image row */
+    int Stride;             /* Bytes from one row to the row below it */
+    const uint8 *Palette;   /* B, G, R, reserved per entry; NULL above 8 bpp */
+} BMP_View_t;
 
 ErrorCode_t BMP_ParseImage(BMP_DataFunc_t *GetData, void *DataParam,
                            BMP_PixelFunc_t *DrawPixels, void *DrawParam,
                            uint8 OutBitDepth);
 
+ErrorCode_t BMP_ViewImage(const uint8 *Data, uint32 DataSize, BMP_View_t *View);
+
+ErrorCode_t BMP_ParseImageBuffer(const uint8 *Data, uint32 DataSize,
+                                 BMP_PixelFunc_t *DrawPixels, BMP_BlockFunc_t *DrawBlock,
+                                 void *DrawParam, uint8 OutBitDepth);
+
 ErrorCode_t BMP_InitImage(BMP_Image_t *Image, uint32 Width, uint32 Height, uint8 BitDepth);
 
 ErrorCode_t BMP_StoreImage(BMP_Image_t *Image, BMP_DataFunc_t *PutData, void *DataParam,
                            BMP_PixelFunc_t *GetPixels, void *PixelParam);
 
+ErrorCode_t BMP_StoreImageBuffer(BMP_Image_t *Image, BMP_DataFunc_t *PutData, void *DataParam,
+                                 const uint8 *Pixels, int Stride);
+
 uint32 BMP_ImageSize(BMP_Image_t *Image);
 
 
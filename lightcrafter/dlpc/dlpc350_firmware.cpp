@@ -40,10 +40,18 @@
 #include <stdlib.h>
 #include <ctype.h>
 #include <string.h>
+#include <math.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <vector>
 
 #include "dlpc350_common.h"
 #include "dlpc350_error.h"
 #include "dlpc350_firmware.h"
+#include "dlpc350_simd.h"
 
 
 
@@ -77,135 +85,102 @@ typedef struct tagBITMAPINFOHEADER {
 
 #define BMP_FILE_HEADER_SIZE        14
 
+#ifdef _WIN32
+#define STRTOK_R    strtok_s
+#else
+#define STRTOK_R    strtok_r
+#endif
+
+/* GUI defined values of DEFAULT.SPLASHLUT followed by those of DEFAULT.SEQPATLUT */
+static uint32 g_iniLutArena[INIPARAM_SPLASHLUT_PARAMS + INIPARAM_SEQPATLUT_PARAMS];
+
 /* Do not change the order of entries. It is used in inisavewindow.cpp to populate the save window with default and gui defined enteries */
-INIPARAM_INFO g_iniParam_Info[] =
+INIPARAM_INFO g_iniParam_Info[NR_INI_TOKENS] =
 {
-    {"APPCONFIG.VERSION.SUBMINOR", {0x00}, {0x00}, 1, 1, false, 0, 1},//SK: Remove
-    {"APPCONFIG.VERSION.MINOR", {0x00}, {0x00}, 1, 1, false, 1, 1}, //SK: Remove
-    {"APPCONFIG.VERSION.MAJOR", {0x03}, {0x00}, 1, 1, false, 2, 1}, //SK:Remove
+    {"APPCONFIG.VERSION.SUBMINOR", {0x00}, {0x00}, 1, 1, false, 0, 1, NULL, 0},//SK: Remove
+    {"APPCONFIG.VERSION.MINOR", {0x00}, {0x00}, 1, 1, false, 1, 1, NULL, 0}, //SK: Remove
+    {"APPCONFIG.VERSION.MAJOR", {0x03}, {0x00}, 1, 1, false, 2, 1, NULL, 0}, //SK:Remove
     //{"APPCONFIG.VERSION.RSERVED", {0x00}, {0x00}, 1, 1, true, 3, 1},
-    {"DEFAULT.FIRMWARE_TAG", {0x44, 0x4C, 0x50}, {0x00}, 3, 1, true, 4, 32},
-    {"DEFAULT.AUTOSTART", {0x00}, {0x00}, 1, 1, false, 36, 1},
-    {"DEFAULT.DISPMODE", {0x00}, {0x00}, 1, 1, true, 37, 1},
-    {"DEFAULT.SHORT_FLIP", {0x00}, {0x00}, 1, 1, true, 38, 1},
-    {"DEFAULT.LONG_FLIP", {0x00}, {0x00}, 1, 1, true, 39, 1},
-    {"DEFAULT.TRIG_OUT_1.POL", {0x00}, {0x00}, 1, 1, true, 104, 1},
-    {"DEFAULT.TRIG_OUT_1.RDELAY", {0xBB}, {0xBB}, 1, 1, true, 105, 1},
-    {"DEFAULT.TRIG_OUT_1.FDELAY", {0xBB}, {0xBB}, 1, 1, true, 106, 1},
-    {"DEFAULT.TRIG_OUT_2.POL", {0x00}, {0x00}, 1, 1, true, 108, 1},
-    {"DEFAULT.TRIG_OUT_2.WIDTH", {0xBB}, {0xBB}, 1, 1, true, 109, 1},
-    {"DEFAULT.TRIG_IN_1.DELAY", {0x00}, {0x00}, 1, 1, true, 112, 4},
+    {"DEFAULT.FIRMWARE_TAG", {0x44, 0x4C, 0x50}, {0x00}, 3, 1, true, 4, 32, NULL, 0},
+    {"DEFAULT.AUTOSTART", {0x00}, {0x00}, 1, 1, false, 36, 1, NULL, 0},
+    {"DEFAULT.DISPMODE", {0x00}, {0x00}, 1, 1, true, 37, 1, NULL, 0},
+    {"DEFAULT.SHORT_FLIP", {0x00}, {0x00}, 1, 1, true, 38, 1, NULL, 0},
+    {"DEFAULT.LONG_FLIP", {0x00}, {0x00}, 1, 1, true, 39, 1, NULL, 0},
+    {"DEFAULT.TRIG_OUT_1.POL", {0x00}, {0x00}, 1, 1, true, 104, 1, NULL, 0},
+    {"DEFAULT.TRIG_OUT_1.RDELAY", {0xBB}, {0xBB}, 1, 1, true, 105, 1, NULL, 0},
+    {"DEFAULT.TRIG_OUT_1.FDELAY", {0xBB}, {0xBB}, 1, 1, true, 106, 1, NULL, 0},
+    {"DEFAULT.TRIG_OUT_2.POL", {0x00}, {0x00}, 1, 1, true, 108, 1, NULL, 0},
+    {"DEFAULT.TRIG_OUT_2.WIDTH", {0xBB}, {0xBB}, 1, 1, true, 109, 1, NULL, 0},
+    {"DEFAULT.TRIG_IN_1.DELAY", {0x00}, {0x00}, 1, 1, true, 112, 4, NULL, 0},
     //{"DEFAULT.TRIG_IN_1.POL", {0x00}, {0x00}, 1, 1, false, 116, 1},
     //{"DEFAULT.TRIG_IN_2.DELAY", {0x00}, {0x00}, 1, 1, false, 120, 4},
-    {"DEFAULT.TRIG_IN_2.POL", {0x00}, {0x00}, 1, 1, true, 124, 1},
-    {"DEFAULT.RED_STROBE.RDELAY", {0xBB}, {0xBB}, 1, 1, true, 128, 1},
-    {"DEFAULT.RED_STROBE.FDELAY", {0xBB}, {0xBB}, 1, 1, true, 129, 1},
-    {"DEFAULT.GRN_STROBE.RDELAY", {0xBB}, {0xBB}, 1, 1, true, 132, 1},
-    {"DEFAULT.GRN_STROBE.FDELAY", {0xBB}, {0xBB}, 1, 1, true, 133, 1},
-    {"DEFAULT.BLU_STROBE.RDELAY", {0xBB}, {0xBB}, 1, 1, true, 136, 1},
-    {"DEFAULT.BLU_STROBE.FDELAY", {0xBB}, {0xBB}, 1, 1, true, 137, 1},
-    {"DEFAULT.INVERTDATA", {0x00}, {0x00}, 1, 1, true, 140, 1},
-    {"DEFAULT.LEDCURRENT_RED", {0x97}, {0x97}, 1, 1, true, 149, 1},
-    {"DEFAULT.LEDCURRENT_GRN", {0x78}, {0x78}, 1, 1, true, 150, 1},
-    {"DEFAULT.LEDCURRENT_BLU", {0x7D}, {0x7D}, 1, 1, true, 151, 1},
-    {"DEFAULT.PATTERNCONFIG.PAT_EXPOSURE", {0x7A120}, {0x7A120}, 1, 1, true, 156, 4},
-    {"DEFAULT.PATTERNCONFIG.PAT_PERIOD", {0x7A120}, {0x7A120}, 1, 1, true, 160, 4},
-    {"DEFAULT.PATTERNCONFIG.PAT_MODE", {0x03}, {0x03}, 1, 1, true, 164, 1},
-    {"DEFAULT.PATTERNCONFIG.TRIG_MODE", {0x1}, {0x1}, 1, 1, true, 165, 1},
-    {"DEFAULT.PATTERNCONFIG.PAT_REPEAT", {0x1}, {0x1}, 1, 1, true, 166, 1},
-    {"DEFAULT.PATTERNCONFIG.NUM_LUT_ENTRIES", {0x02}, {0x1}, 1, 1, true, 168, 2},
-    {"DEFAULT.PATTERNCONFIG.NUM_PATTERNS", {0x02}, {0x1}, 1, 1, true, 170, 2},
-    {"DEFAULT.PATTERNCONFIG.NUM_SPLASH", {0x00}, {0x00}, 1, 1, true, 172, 2},
-    {"DEFAULT.SPLASHLUT", {0x01}, {0x0}, 1, 1, true, 176, 256},
-    {"DEFAULT.SEQPATLUT", {0x00061800, 0x00022804, 0x00024808}, {0x0}, 3, 1, true, 432, 29184},
-    {"DEFAULT.LED_ENABLE_MAN_MODE", {0x0}, {0x0}, 1, 1, true, 29616, 1},
-    {"DEFAULT.MAN_ENABLE_RED_LED", {0x0}, {0x0}, 1, 1, true, 29617, 1},
-    {"DEFAULT.MAN_ENABLE_GRN_LED", {0x0}, {0x0}, 1, 1, true, 29618, 1},
-    {"DEFAULT.MAN_ENABLE_BLU_LED", {0x0}, {0x0}, 1, 1, true, 29619, 1},
-    {"DEFAULT.PORTCONFIG.PORT",{0x0}, {0x0},1, 1, true, 40, 1},
-    {"DEFAULT.PORTCONFIG.BPP", {0x1}, {0x1}, 1, 1, true, 41, 1},
-    {"DEFAULT.PORTCONFIG.PIX_FMT", {0x0}, {0x0}, 1, 1, true, 42, 1},
-    {"DEFAULT.PORTCONFIG.PORT_CLK", {0x0}, {0x0}, 1, 1, true, 43, 1},
+    {"DEFAULT.TRIG_IN_2.POL", {0x00}, {0x00}, 1, 1, true, 124, 1, NULL, 0},
+    {"DEFAULT.RED_STROBE.RDELAY", {0xBB}, {0xBB}, 1, 1, true, 128, 1, NULL, 0},
+    {"DEFAULT.RED_STROBE.FDELAY", {0xBB}, {0xBB}, 1, 1, true, 129, 1, NULL, 0},
+    {"DEFAULT.GRN_STROBE.RDELAY", {0xBB}, {0xBB}, 1, 1, true, 132, 1, NULL, 0},
+    {"DEFAULT.GRN_STROBE.FDELAY", {0xBB}, {0xBB}, 1, 1, true, 133, 1, NULL, 0},
+    {"DEFAULT.BLU_STROBE.RDELAY", {0xBB}, {0xBB}, 1, 1, true, 136, 1, NULL, 0},
+    {"DEFAULT.BLU_STROBE.FDELAY", {0xBB}, {0xBB}, 1, 1, true, 137, 1, NULL, 0},
+    {"DEFAULT.INVERTDATA", {0x00}, {0x00}, 1, 1, true, 140, 1, NULL, 0},
+    {"DEFAULT.LEDCURRENT_RED", {0x97}, {0x97}, 1, 1, true, 149, 1, NULL, 0},
+    {"DEFAULT.LEDCURRENT_GRN", {0x78}, {0x78}, 1, 1, true, 150, 1, NULL, 0},
+    {"DEFAULT.LEDCURRENT_BLU", {0x7D}, {0x7D}, 1, 1, true, 151, 1, NULL, 0},
+    {"DEFAULT.PATTERNCONFIG.PAT_EXPOSURE", {0x7A120}, {0x7A120}, 1, 1, true, 156, 4, NULL, 0},
+    {"DEFAULT.PATTERNCONFIG.PAT_PERIOD", {0x7A120}, {0x7A120}, 1, 1, true, 160, 4, NULL, 0},
+    {"DEFAULT.PATTERNCONFIG.PAT_MODE", {0x03}, {0x03}, 1, 1, true, 164, 1, NULL, 0},
+    {"DEFAULT.PATTERNCONFIG.TRIG_MODE", {0x1}, {0x1}, 1, 1, true, 165, 1, NULL, 0},
+    {"DEFAULT.PATTERNCONFIG.PAT_REPEAT", {0x1}, {0x1}, 1, 1, true, 166, 1, NULL, 0},
+    {"DEFAULT.PATTERNCONFIG.NUM_LUT_ENTRIES", {0x02}, {0x1}, 1, 1, true, 168, 2, NULL, 0},
+    {"DEFAULT.PATTERNCONFIG.NUM_PATTERNS", {0x02}, {0x1}, 1, 1, true, 170, 2, NULL, 0},
+    {"DEFAULT.PATTERNCONFIG.NUM_SPLASH", {0x00}, {0x00}, 1, 1, true, 172, 2, NULL, 0},
+    {"DEFAULT.SPLASHLUT", {0x01}, {0x0}, 1, 1, true, 176, 256, &g_iniLutArena[0], INIPARAM_SPLASHLUT_PARAMS},
+    {"DEFAULT.SEQPATLUT", {0x00061800, 0x00022804, 0x00024808}, {0x0}, 3, 1, true, 432, 29184, &g_iniLutArena[INIPARAM_SPLASHLUT_PARAMS], INIPARAM_SEQPATLUT_PARAMS},
+    {"DEFAULT.LED_ENABLE_MAN_MODE", {0x0}, {0x0}, 1, 1, true, 29616, 1, NULL, 0},
+    {"DEFAULT.MAN_ENABLE_RED_LED", {0x0}, {0x0}, 1, 1, true, 29617, 1, NULL, 0},
+    {"DEFAULT.MAN_ENABLE_GRN_LED", {0x0}, {0x0}, 1, 1, true, 29618, 1, NULL, 0},
+    {"DEFAULT.MAN_ENABLE_BLU_LED", {0x0}, {0x0}, 1, 1, true, 29619, 1, NULL, 0},
+    {"DEFAULT.PORTCONFIG.PORT",{0x0}, {0x0},1, 1, true, 40, 1, NULL, 0},
+    {"DEFAULT.PORTCONFIG.BPP", {0x1}, {0x1}, 1, 1, true, 41, 1, NULL, 0},
+    {"DEFAULT.PORTCONFIG.PIX_FMT", {0x0}, {0x0}, 1, 1, true, 42, 1, NULL, 0},
+    {"DEFAULT.PORTCONFIG.PORT_CLK", {0x0}, {0x0}, 1, 1, true, 43, 1, NULL, 0},
     //{"DEFAULT.PORTCONFIG.CSC[0]", {0x0400, 0x0000, 0x0000, 0x0000, 0x0400, 0x0000, 0x0000, 0x0000, 0x0400}, {0}, 9, 1, false, 44, 18},
     //{"DEFAULT.PORTCONFIG.CSC[1]", {0x04A8, 0xFDC7, 0xFF26, 0x04A8, 0x0715, 0x0000, 0x04A8, 0x0000, 0x0875}, {0}, 9, 1, false, 62, 18},
     //{"DEFAULT.PORTCONFIG.CSC[2]", {0x04A8, 0xFCC0, 0xFE6F, 0x04A8, 0x0662, 0x0000, 0x04A8, 0x0000, 0x0812}, {0}, 9, 1, false, 80, 18},
-    {"DEFAULT.PORTCONFIG.ABC_MUX", {0x4}, {0x4}, 1, 1, true, 100, 1},
-    {"DEFAULT.PORTCONFIG.PIX_MODE", {0x1}, {0x1}, 1, 1, true, 101, 1},
-    {"DEFAULT.PORTCONFIG.SWAP_POL", {0x1}, {0x1}, 1, 1 ,true, 102, 1},
-    {"DEFAULT.PORTCONFIG.FLD_SEL", {0x0}, {0x0}, 1, 1, true, 103, 1},
-    {"PERIPHERALS.I2CADDRESS[0]", {0x34}, {0x34}, 1, 1, false, 29649, 1},
-    {"PERIPHERALS.I2CADDRESS[1]", {0x3A}, {0x3A}, 1, 1, false, 29650, 1},
+    {"DEFAULT.PORTCONFIG.ABC_MUX", {0x4}, {0x4}, 1, 1, true, 100, 1, NULL, 0},
+    {"DEFAULT.PORTCONFIG.PIX_MODE", {0x1}, {0x1}, 1, 1, true, 101, 1, NULL, 0},
+    {"DEFAULT.PORTCONFIG.SWAP_POL", {0x1}, {0x1}, 1, 1 ,true, 102, 1, NULL, 0},
+    {"DEFAULT.PORTCONFIG.FLD_SEL", {0x0}, {0x0}, 1, 1, true, 103, 1, NULL, 0},
+    {"PERIPHERALS.I2CADDRESS[0]", {0x34}, {0x34}, 1, 1, false, 29649, 1, NULL, 0},
+    {"PERIPHERALS.I2CADDRESS[1]", {0x3A}, {0x3A}, 1, 1, false, 29650, 1, NULL, 0},
     //{"PERIPHERALS.USB_SRL[0]", {0x004C, 0x0043, 0x0052, 0x0032}, {0x0}, 4, 1, false, 29656, 8},
     //{"PERIPHERALS.USB_SRL[1]", {0x004C, 0x0043, 0x0052, 0x0033}, {0x0}, 4, 1, false, 29664, 8},
-    {"DATAPATH.SPLASHSTARTUPTIMEOUT", {0x1388}, {0x1388}, 1, 1, false, 29676, 2},
-    {"DATAPATH.SPLASHATSTARTUPENABLE", {0x01}, {0x1}, 1, 1, true, 29680, 1},
-    {"MACHINE_DATA.COLORPROFILE_0_BRILLIANTCOLORLOOK", {0x0}, {0x0}, 1, 1, true, 29750, 1},
+    {"DATAPATH.SPLASHSTARTUPTIMEOUT", {0x1388}, {0x1388}, 1, 1, false, 29676, 2, NULL, 0},
+    {"DATAPATH.SPLASHATSTARTUPENABLE", {0x01}, {0x1}, 1, 1, true, 29680, 1, NULL, 0},
+    {"MACHINE_DATA.COLORPROFILE_0_BRILLIANTCOLORLOOK", {0x0}, {0x0}, 1, 1, true, 29750, 1, NULL, 0},
 };
 
 
-uint32 FLASH_TABLE_ADDRESS = 0x00020000;
-
-unsigned char *pFrmwImageArray;
-unsigned char *splBuffer;
-unsigned int splash_index;
-unsigned int splash_data_start_flash_address;
-unsigned int appl_config_data_flash_address;
-int splash_count;
-
 #define FLASH_THREE_ADDRESS					0xFB000000	// actually it is re map to 0xF8000000
 #define FLASH_TWO_ADDRESS					0xFA000000
 #define FLASH_BASE_ADDRESS					0xF9000000
 
-//unsigned int ChipSelectSize[3] = {0x01000000, 0x01000000, 0x01000000};
-unsigned int ChipSelectSize[3] = {0x00000000, 0x01000000, 0x01000000};  // LightCrafter 4500 does not have third chip
-unsigned int ChipSelectEnd[3]  = {0xFC000000, 0xFA000000, 0xFB000000};
-unsigned int ChipSelectBase[3] = {0xFB000000, 0xF9000000, 0xFA000000};
-
-static int SPLASH_PerformLineCompression(unsigned char *SourceAddr, int ImageWidth, int ImageHeight, uint32 *compressed_size, uint8 numLines)
-{
-    uint16 Row, Col;
-    uint32 lineLength, bytesPerPixel = 3, imageHeight, pixelIndex;
-    unsigned char *line1Data, *line2Data;
-
-    lineLength =  ImageWidth * bytesPerPixel;
-
-    if(lineLength % 4 != 0)
-    {
-        lineLength = (lineLength / 4 + 1) * 4;
-    }
-
-    if(numLines > 8)
-    {
-        *compressed_size = 0xFFFFFFFF;
-        return 1;
-    }
-
-    imageHeight = (ImageHeight / numLines) * numLines;
-
-    for (Row = 0; Row < (imageHeight - numLines); Row++)
-    {
-        line1Data = (unsigned char *)(SourceAddr + (lineLength *  Row));
-        line2Data = (unsigned char *)(SourceAddr + (lineLength * (Row + numLines)));
+/* worst case RLE stream: every pixel literal, a 2 byte escape per 255 pixels, end of line with padding, end of file */
+#define SPLASH_RLE_MAX_SIZE(w, h)           ((h) * ((w) * 3 + ((w) / 255 + 1) * 2 + 5) + 16)
 
-        for (Col = 0; Col < ImageWidth; Col++)
-        {
-            pixelIndex = Col * bytesPerPixel;
+/* rows flipped and then hashed together by SPLASH_LoadImage, small enough to stay in cache */
+#define SPLASH_LOAD_BLOCK_ROWS              16
 
-            if( (line1Data[pixelIndex  ] != line2Data[pixelIndex  ]) ||
-                    (line1Data[pixelIndex+1] != line2Data[pixelIndex+1]) ||
-                    (line1Data[pixelIndex+2] != line2Data[pixelIndex+2]))
-            {
-                *compressed_size = 0xFFFFFFFF;
-                return 1;
-            }
-        }
-    }
+/* rows encoded to estimate the RLE size in auto compression */
+#define SPLASH_RLE_SAMPLE_ROWS              32
 
-    *compressed_size = numLines * lineLength;
-    return 0;
-}
+/* rows of one image written per task by DLPC350_Frmw_RenderPatterns */
+#define PATTERN_ROWS_PER_TASK               64
 
-static int SPLASH_PerformRLECompression(unsigned char *SourceAddr, unsigned char *DestinationAddr, int ImageWidth, int ImageHeight, uint32 *compressed_size)
+/*
+ * Per-pixel RLE encoder as shipped with the TI GUI. Kept as the reference for
+ * SPLASH_PerformRLECompression, see DLPC350_Frmw_BenchmarkRLE.
+ */
+static int SPLASH_PerformRLECompressionReference(const unsigned char *SourceAddr, unsigned char *DestinationAddr, int ImageWidth, int ImageHeight, uint32 *compressed_size)
 {
     uint16 Row, Col;
     BOOL   FirstPixel = TRUE;
@@ -338,274 +313,1574 @@ static int SPLASH_PerformRLECompression(unsigned char *SourceAddr, unsigned char
     return 0;
 }
 
-static int SPLASH_PerformRLEUnCompression(unsigned char *SourceAddr, unsigned char *DestinationAddr, uint32 *size)
-{
-    uint32 PixelSize= 3, S = 0, D = 0;
-    int i;
+/*
+ * Vectorized RLE encoder. Produces the same stream as SPLASH_PerformRLECompressionReference,
+ * but finds runs of equal and of differing pixels many pixels at a time and then applies the
+ * reference encoder's state transitions once per span instead of once per pixel.
+ */
 
-    while (S < *size)
-    {
-        uint32 ctrl_byte, color_byte;
+/* Length of the span starting at pixel i (i >= 1, i < end) in which every pixel equals
+ * (SPLASH_ScanEqual) or differs from (SPLASH_ScanDiffer) the pixel before it */
+typedef uint32 (*SPLASH_SCAN_FUNC)(const unsigned char *pRow, uint32 i, uint32 end);
 
-        ctrl_byte = SourceAddr[S];
-        color_byte = SourceAddr[S + 1];
-        if (ctrl_byte == 0)
-        {
-            if (color_byte == 1)	// End of image
-                break;
-            else if (color_byte == 0)	// End of Line.
-            {
-                i = 0;
-                S +=2;
-                if (S % 4 != 0)
-                {
-                    int pad = 4 - (S % 4);
-                    S += pad;
-                }
-            }
-            else if (color_byte >= 2)
-            {
-                S +=2;
-                memcpy(DestinationAddr + D, SourceAddr + S, color_byte * PixelSize);
-                D += color_byte * PixelSize;
-                S += color_byte * PixelSize;
-            }
-            else
-                return -1;
-        }
-        else if (ctrl_byte > 0)
-        {
-            S++;
-            for (i = 0; (unsigned int)i < ctrl_byte; i++)
-            {
-                memcpy(DestinationAddr + D, SourceAddr + S, PixelSize);
-                D += PixelSize;
-            }
-            S += PixelSize;
-        }
-        else
-            return -1;
-    }
-    *size = D;
-    return 0;
+static inline bool SPLASH_PixelEqual(const unsigned char *a, const unsigned char *b)
+{
+    return a[0] == b[0] && a[1] == b[1] && a[2] == b[2];
 }
 
-int DLPC350_Frmw_CopyAndVerifyImage(const unsigned char *pByteArray, int size)
+static uint32 SPLASH_ScanEqual(const unsigned char *pRow, uint32 i, uint32 end)
 {
-    FLASH_TABLE *flash_table;
+    uint32 j = i;
 
-    if (pFrmwImageArray != NULL)
-    {
-        free(pFrmwImageArray);
-        pFrmwImageArray = NULL;
-        splash_data_start_flash_address = 0;
-        appl_config_data_flash_address = 0;
-    }
+    while (j < end && SPLASH_PixelEqual(pRow + j * 3, pRow + (j - 1) * 3))
+        j++;
 
+    return j - i;
+}
 
-    pFrmwImageArray = (unsigned char *)malloc(size);
-    if (pFrmwImageArray == NULL)
-        return ERROR_NO_MEM_FOR_MALLOC;
+static uint32 SPLASH_ScanDiffer(const unsigned char *pRow, uint32 i, uint32 end)
+{
+    uint32 j = i;
 
-    memcpy(pFrmwImageArray, pByteArray, size);
+    while (j < end && !SPLASH_PixelEqual(pRow + j * 3, pRow + (j - 1) * 3))
+        j++;
 
-    flash_table = (FLASH_TABLE *)(pFrmwImageArray + FLASH_TABLE_ADDRESS);
+    return j - i;
+}
 
-    if(flash_table->Signature != FLASHTABLE_APP_SIGNATURE)
-    {
-        FLASH_TABLE_ADDRESS = 0x00008000;
+#if DLPC350_SIMD_X86
+/* Bit 3k of a byte equality mask covers pixel k; it is kept when bytes 3k..3k+2 all match */
+#define SPLASH_PIXEL_BITS_5         0x00001249
+#define SPLASH_PIXEL_BITS_10        0x09249249
 
-        flash_table = (FLASH_TABLE *)(pFrmwImageArray + FLASH_TABLE_ADDRESS);
+static inline uint32 SPLASH_CountTrailingZeros(uint32 value)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, value);
+    return index;
+#else
+    return __builtin_ctz(value);
+#endif
+}
 
-        if(flash_table->Signature != FLASHTABLE_APP_SIGNATURE)
-        {
-            FLASH_TABLE_ADDRESS = 0x00020000;
+DLPC350_TARGET("sse2")
+static uint32 SPLASH_PixelMaskSSE2(const unsigned char *pPrev)
+{
+    __m128i a = _mm_loadu_si128((const __m128i *)pPrev);
+    __m128i b = _mm_loadu_si128((const __m128i *)(pPrev + 3));
+    uint32 m = _mm_movemask_epi8(_mm_cmpeq_epi8(a, b));
+    return m & (m >> 1) & (m >> 2) & SPLASH_PIXEL_BITS_5;
+}
 
-            flash_table = (FLASH_TABLE *)(pFrmwImageArray + FLASH_TABLE_ADDRESS);
+DLPC350_TARGET("sse2")
+static uint32 SPLASH_ScanEqualSSE2(const unsigned char *pRow, uint32 i, uint32 end)
+{
+    uint32 j = i, mask;
 
-            if(flash_table->Signature != FLASHTABLE_APP_SIGNATURE)
-                return ERROR_FRMW_FLASH_TABLE_SIGN_MISMATCH;
-        }
+    /* 5 pixels per step, loads stay below pixel end */
+    while (j * 3 + 16 <= end * 3)
+    {
+        mask = SPLASH_PixelMaskSSE2(pRow + (j - 1) * 3);
+        if (mask != SPLASH_PIXEL_BITS_5)
+            return j - i + SPLASH_CountTrailingZeros(~mask & SPLASH_PIXEL_BITS_5) / 3;
+        j += 5;
     }
-    splash_data_start_flash_address = flash_table->Splash_Data[FLASH_TABLE_SPLASH_INDEX].Address;
-    appl_config_data_flash_address = flash_table->APPL_Config_Data[0].Address;
 
-    return 0;
+    return j - i + SPLASH_ScanEqual(pRow, j, end);
 }
 
-unsigned int DLPC350_Frmw_GetVersionNumber()
+DLPC350_TARGET("sse2")
+static uint32 SPLASH_ScanDifferSSE2(const unsigned char *pRow, uint32 i, uint32 end)
 {
-    uint32 version_number;
+    uint32 j = i, mask;
 
-    if (!appl_config_data_flash_address)
-        return ERROR_INIT_NOT_DONE_PROPERLY;
-    memcpy(&version_number, pFrmwImageArray + (appl_config_data_flash_address - FLASH_BASE_ADDRESS), sizeof(version_number));
+    while (j * 3 + 16 <= end * 3)
+    {
+        mask = SPLASH_PixelMaskSSE2(pRow + (j - 1) * 3);
+        if (mask != 0)
+            return j - i + SPLASH_CountTrailingZeros(mask) / 3;
+        j += 5;
+    }
 
-    return version_number;
+    return j - i + SPLASH_ScanDiffer(pRow, j, end);
 }
 
-int DLPC350_Frmw_WriteApplConfigData(char *token, uint32 *params, int numParams)
+DLPC350_TARGET("avx2")
+static uint32 SPLASH_PixelMaskAVX2(const unsigned char *pPrev)
 {
-    int i;
-    int j;
-    int index = -1;
-    int offset;
-    char toUpperToken[128];
-    static int trigMode = -1;
+    __m256i a = _mm256_loadu_si256((const __m256i *)pPrev);
+    __m256i b = _mm256_loadu_si256((const __m256i *)(pPrev + 3));
+    uint32 m = (uint32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b));
+    return m & (m >> 1) & (m >> 2) & SPLASH_PIXEL_BITS_10;
+}
 
-    uint32 appl_config_data_start_address = appl_config_data_flash_address - FLASH_BASE_ADDRESS;
-    uint8 *app_data = (uint8 *)(pFrmwImageArray + appl_config_data_start_address);
+DLPC350_TARGET("avx2")
+static uint32 SPLASH_ScanEqualAVX2(const unsigned char *pRow, uint32 i, uint32 end)
+{
+    uint32 j = i, mask;
 
-    if (!appl_config_data_flash_address)
-        return ERROR_INIT_NOT_DONE_PROPERLY;
+    /* 10 pixels per step */
+    while (j * 3 + 32 <= end * 3)
+    {
+        mask = SPLASH_PixelMaskAVX2(pRow + (j - 1) * 3);
+        if (mask != SPLASH_PIXEL_BITS_10)
+            return j - i + SPLASH_CountTrailingZeros(~mask & SPLASH_PIXEL_BITS_10) / 3;
+        j += 10;
+    }
 
-    //Convert everything to uppercase for string comparison
-    i = 0;
-    while(token[i] != '\0')
+    return j - i + SPLASH_ScanEqual(pRow, j, end);
+}
+
+DLPC350_TARGET("avx2")
+static uint32 SPLASH_ScanDifferAVX2(const unsigned char *pRow, uint32 i, uint32 end)
+{
+    uint32 j = i, mask;
+
+    while (j * 3 + 32 <= end * 3)
     {
-        toUpperToken[i] = toupper(token[i]);
-        i++;
+        mask = SPLASH_PixelMaskAVX2(pRow + (j - 1) * 3);
+        if (mask != 0)
+            return j - i + SPLASH_CountTrailingZeros(mask) / 3;
+        j += 10;
     }
-    toUpperToken[i] = '\0';
 
-    for (index = 0; index < NR_INI_TOKENS; index++)
-        if(strcmp(&g_iniParam_Info[index].token[0],&toUpperToken[0]) == 0)
-            break;
+    return j - i + SPLASH_ScanDiffer(pRow, j, end);
+}
+#endif
 
-    if (index == NR_INI_TOKENS) //if no match found in the above search
-        return ERROR_WRONG_PARAMS;
+static inline uint32 SPLASH_EmitRun(unsigned char *pDest, uint32 D, uint8 repeat, const unsigned char *pPixel)
+{
+    pDest[D] = repeat;
+    memcpy(pDest + D + 1, pPixel, 3);
+    return D + 4;
+}
 
-    offset = g_iniParam_Info[index].frmw_offset;
+/* count > 1 is written as an escaped literal, a single pixel as a run of one */
+static inline uint32 SPLASH_EmitLiteral(unsigned char *pDest, uint32 D, uint8 count, const unsigned char *pPixels)
+{
+    if (count > 1)
+        pDest[D++] = 0;
+    pDest[D++] = count;
+    memcpy(pDest + D, pPixels, count * 3);
+    return D + count * 3;
+}
 
-    if(strcmp("DEFAULT.PORTCONFIG.CSC",&toUpperToken[0]) == 0)
-    {
-        if(numParams != 9)
-            return ERROR_WRONG_PARAMS;
+static void SPLASH_SelectScanKernels(SPLASH_SCAN_FUNC *pScanEqual, SPLASH_SCAN_FUNC *pScanDiffer)
+{
+    *pScanEqual = SPLASH_ScanEqual;
+    *pScanDiffer = SPLASH_ScanDiffer;
 
-        for(i = 0; i < 9; i++)
-        {
-            *((uint16*) (app_data + offset)) = (uint16)params[i];
-            offset += 2;
-        }
+#if DLPC350_SIMD_X86
+    if (DLPC350_CpuFeatures() & CPU_FEATURE_AVX2)
+    {
+        *pScanEqual = SPLASH_ScanEqualAVX2;
+        *pScanDiffer = SPLASH_ScanDifferAVX2;
     }
-    else if (strcmp("DEFAULT.SPLASHLUT",&toUpperToken[0]) == 0)
+    else if (DLPC350_CpuFeatures() & CPU_FEATURE_SSE2)
     {
-        //legacy trigger mode
-        if(trigMode >= 0 && trigMode <= 2)
+        *pScanEqual = SPLASH_ScanEqualSSE2;
+        *pScanDiffer = SPLASH_ScanDifferSSE2;
+    }
+#endif
+}
+
+/* Encodes one row including its end of line. Rows start and end 32-bit aligned, so the
+ * stream of a row depends on its pixels only. Returns the new destination offset. */
+static uint32 SPLASH_EncodeRLERow(const unsigned char *pRow, uint32 width, unsigned char *DestinationAddr, uint32 D,
+                                  SPLASH_SCAN_FUNC scanEqual, SPLASH_SCAN_FUNC scanDiffer)
+{
+    uint32 i = 0, n, repeat = 1, count = 0, last = 0, pad;
+    bool first = true;
+
+    while (i < width)
+    {
+        if (first)
         {
-            //Legacy pattern sequence maxsize = 64
-            if((numParams < 1) || (numParams > MAX_IMAGE_LUT_ENTRIES))
-                return ERROR_WRONG_PARAMS;
+            /* start a new run at pixel i */
+            last = i++;
+            repeat = 1;
+            count = 0;
+            first = false;
+            if (i == width)
+                D = SPLASH_EmitRun(DestinationAddr, D, 1, pRow + last * 3);
         }
-        else
+        else if (SPLASH_PixelEqual(pRow + i * 3, pRow + (i - 1) * 3))
         {
-            //Variable exposure trigger mode
-            if(trigMode > 2 && trigMode <= 4)
+            /* the pending literal ends before the pixel that starts repeating */
+            if (count)
             {
-                //Variable exposure pattern sequence maxsize = 256
-                if((numParams < 1) || (numParams > MAX_VAR_EXP_IMAGE_LUT_ENTRIES))
-                    return ERROR_WRONG_PARAMS;
+                D = SPLASH_EmitLiteral(DestinationAddr, D, (uint8)count, pRow + (i - 1 - count) * 3);
+                count = 0;
             }
-            else
-                return ERROR_WRONG_PARAMS;
-        }
 
-        //Special case for two entries
-        if(numParams == 2)
-        {
-            *((uint8*) (app_data + offset)) = (uint8)params[1];
-            offset ++;
+            n = scanEqual(pRow, i, MIN(width, i + 255 - repeat));
+            repeat += n;
+            i += n;
 
-            *((uint8*) (app_data + offset)) = (uint8)params[0];
-            offset ++;
-        }
-        else
-        {
-            for (i = 0; i < numParams; i++)
+            if (repeat == 255)
             {
-                *((uint8*) (app_data + offset)) = (uint8)params[i];
-                offset ++;
+                D = SPLASH_EmitRun(DestinationAddr, D, 255, pRow + last * 3);
+                first = true;
             }
+            else if (i == width)
+                D = SPLASH_EmitRun(DestinationAddr, D, (uint8)repeat, pRow + last * 3);
         }
-    }
-    else if (strcmp("DEFAULT.SEQPATLUT",&toUpperToken[0]) == 0)
-    {
-
-        //legacy trigger mode
-        if(trigMode >= 0 && trigMode <= 2)
+        else if (repeat > 1)
         {
-            //Legacy pattern sequence maxsize = 128
-            if((numParams < 1) || (numParams > MAX_PAT_LUT_ENTRIES))
-                return ERROR_WRONG_PARAMS;
-
-            //16-BYTES space available per entry
-            for (i = 0; i < numParams; i++)
-            {
-                //BYTE - 3 Rsvd
-                *((uint8*) (app_data + offset)) = (uint8)((params[i] >> 24) & 0xFF);
-                offset ++;
-
-                //BYTE - 0
-                *((uint8*) (app_data + offset)) = (uint8)((params[i] >> 0) & 0xFF);
-                offset ++;
-
-                //BYTE - 1
-                *((uint8*) (app_data + offset)) = (uint8)((params[i] >> 8) & 0xFF);
-                offset ++;
-
-                //BYTE - 2
-                *((uint8*) (app_data + offset)) = (uint8)((params[i] >> 16) & 0xFF);
-                offset ++;
-
-                //fill remaining 12 - bytes with zeros
-                for(j = 0; j < 12; j++)
-                {
-                    *((uint8*) (app_data + offset)) = (uint8) 0x00;
-                    offset ++;
-                }
-            }
+            D = SPLASH_EmitRun(DestinationAddr, D, (uint8)repeat, pRow + last * 3);
+            repeat = 1;
+            last = i++;
+            if (i == width)
+                D = SPLASH_EmitRun(DestinationAddr, D, 1, pRow + last * 3);
         }
         else
         {
-            //Variable exposure trigger mode
-            if(trigMode > 2 && trigMode <= 4)
+            /* every differing pixel pushes the previous one into the literal */
+            n = scanDiffer(pRow, i, MIN(width, i + 255 - count));
+            count += n;
+            i += n;
+            last = i - 1;
+
+            if (count == 255)
             {
-                //Variable exposure pattern sequence maxsize = 1824
-                if((numParams < 1) || (numParams > (MAX_VAR_EXP_PAT_LUT_ENTRIES*3)))
-                    return ERROR_WRONG_PARAMS;
+                D = SPLASH_EmitLiteral(DestinationAddr, D, 255, pRow + (i - 256) * 3);
+                count = 0;
             }
-            else
-                return ERROR_WRONG_PARAMS;
 
-            //16-BYTES space available per entry - maximum can be 1824x3 32bit params
-            for (i = 0; i < (numParams/3); i++)
+            if (i == width)
             {
-                //BYTE - 3 Rsvd
-                *((uint8*) (app_data + offset)) = (uint8)((params[i*3] >> 24) & 0xFF);
-                offset ++;
+                if (count)
+                    D = SPLASH_EmitLiteral(DestinationAddr, D, (uint8)(count + 1), pRow + (width - 1 - count) * 3);
+                else
+                    D = SPLASH_EmitRun(DestinationAddr, D, 1, pRow + last * 3);
+            }
+        }
+    }
 
-                //BYTE - 0
-                *((uint8*) (app_data + offset)) = (uint8)((params[i*3] >> 0) & 0xFF);
-                offset ++;
+    // END OF LINE
+    DestinationAddr[D++] = 0;
+    DestinationAddr[D++] = 0;
 
-                //BYTE - 1
-                *((uint8*) (app_data + offset)) = (uint8)((params[i*3] >> 8) & 0xFF);
-                offset ++;
+    /* Scan lines are always padded out to next 32-bit boundary */
+    if(D % 4 != 0)
+    {
+        pad = 4 - (D % 4);
+        memset(DestinationAddr + D, 0, pad);
+        D += pad;
+    }
 
-                //BYTE - 2
-                *((uint8*) (app_data + offset)) = (uint8)((params[i*3] >> 16) & 0xFF);
-                offset ++;
+    return D;
+}
 
-                //Fill Pattern exposure 32-bit information
-                //LSB
-                *((uint8*) (app_data + offset)) = (uint8)((params[i*3+1] >> 0) & 0xFF);
-                offset ++;
+static int SPLASH_PerformRLECompressionPeriodic(const unsigned char *SourceAddr, unsigned char *DestinationAddr, int ImageWidth, int ImageHeight, int period, uint32 *compressed_size)
+/**
+ * RLE encodes an image. With period > 0 the rows are known to repeat every period rows, so
+ * only the first period rows are encoded and their stream is repeated. Rows are read
+ * ImageWidth * 3 bytes apart, as the encoder always has.
+ */
+{
+    SPLASH_SCAN_FUNC scanEqual, scanDiffer;
+    uint32 width = ImageWidth, D = 0, pad, periodSize;
+    int Row;
 
-                //LSB+1
-                *((uint8*) (app_data + offset)) = (uint8)((params[i*3+1] >> 8) & 0xFF);
-                offset ++;
+    SPLASH_SelectScanKernels(&scanEqual, &scanDiffer);
 
-                //LSB+2
+    if (period <= 0 || period > ImageHeight)
+        period = ImageHeight;
+
+    for (Row = 0; Row < period; Row++)
+        D = SPLASH_EncodeRLERow(SourceAddr + Row * width * 3, width, DestinationAddr, D, scanEqual, scanDiffer);
+
+    /* repeat whole periods, then the rows of the last partial period */
+    periodSize = D;
+    for (Row = period; Row + period <= ImageHeight; Row += period, D += periodSize)
+        memcpy(DestinationAddr + D, DestinationAddr, periodSize);
+    for (; Row < ImageHeight; Row++)
+        D = SPLASH_EncodeRLERow(SourceAddr + Row * width * 3, width, DestinationAddr, D, scanEqual, scanDiffer);
+
+    /* End of file: Control Byte = 0 & Color Byte = 1 */
+    DestinationAddr[D++] = 0;
+    DestinationAddr[D++] = 1;
+
+    /* End of file should be padded out till 128-bit boundary */
+    if(D % 16 != 0)
+    {
+        pad = 16 - (D % 16);
+        memset(DestinationAddr + D, 0, pad);
+        D += pad;
+    }
+
+    *compressed_size = D;
+
+    return 0;
+}
+
+static int SPLASH_PerformRLECompression(const unsigned char *SourceAddr, unsigned char *DestinationAddr, int ImageWidth, int ImageHeight, uint32 *compressed_size)
+{
+    return SPLASH_PerformRLECompressionPeriodic(SourceAddr, DestinationAddr, ImageWidth, ImageHeight, 0, compressed_size);
+}
+
+static int SPLASH_FindLinePeriod(const unsigned char *SourceAddr, int ImageWidth, int ImageHeight, uint32 lineLength)
+/**
+ * Finds the smallest of 1, 2, 4 or 8 lines after which every row of the image repeats.
+ * Each candidate stops at its first mismatching row, which for non-periodic images is
+ * almost always within the first few rows.
+ *
+ * @return  the period, 0 if none of them fits
+ *
+ */
+{
+    static const int periods[] = { 1, 2, 4, 8 };
+    uint32 rowBytes = ImageWidth * 3;
+    int i, Row;
+
+    for (i = 0; i < (int)(sizeof(periods) / sizeof(periods[0])); i++)
+    {
+        for (Row = 0; Row + periods[i] < ImageHeight; Row++)
+        {
+            if (memcmp(SourceAddr + lineLength * Row, SourceAddr + lineLength * (Row + periods[i]), rowBytes) != 0)
+                break;
+        }
+
+        if (Row + periods[i] >= ImageHeight)
+            return periods[i];
+    }
+
+    return 0;
+}
+
+static uint32 SPLASH_EstimateRLESize(const unsigned char *SourceAddr, int ImageWidth, int ImageHeight)
+/**
+ * Predicts the RLE stream size from up to SPLASH_RLE_SAMPLE_ROWS evenly spaced rows.
+ *
+ * @return  the estimate, 0xFFFFFFFF if no scratch memory
+ *
+ */
+{
+    SPLASH_SCAN_FUNC scanEqual, scanDiffer;
+    unsigned char *rowBuffer;
+    uint32 width = ImageWidth, total = 0;
+    int i, numSamples = MIN(ImageHeight, SPLASH_RLE_SAMPLE_ROWS);
+
+    rowBuffer = (unsigned char *)malloc(SPLASH_RLE_MAX_SIZE(width, 1));
+    if (rowBuffer == NULL)
+        return 0xFFFFFFFF;
+
+    SPLASH_SelectScanKernels(&scanEqual, &scanDiffer);
+
+    for (i = 0; i < numSamples; i++)
+    {
+        int Row = (int)(((long long)i * ImageHeight) / numSamples);
+        total += SPLASH_EncodeRLERow(SourceAddr + Row * width * 3, width, rowBuffer, 0, scanEqual, scanDiffer);
+    }
+
+    free(rowBuffer);
+
+    return (uint32)(((unsigned long long)total * ImageHeight) / numSamples) + 16;
+}
+
+/* 8 pixels as three separate 64-bit stores */
+static inline void SPLASH_StorePattern(unsigned char *pDest, unsigned long long word0, unsigned long long word1, unsigned long long word2)
+{
+    memcpy(pDest, &word0, 8);
+    memcpy(pDest + 8, &word1, 8);
+    memcpy(pDest + 16, &word2, 8);
+}
+
+static int SPLASH_PerformRLEUnCompression(const unsigned char *SourceAddr, uint32 SourceSize, unsigned char *DestinationAddr, uint32 *size)
+/**
+ * Expands an RLE stream. Every source read and destination write is checked, so a corrupt
+ * stream fails instead of running past either buffer.
+ *
+ * @param   SourceAddr - I - RLE stream
+ * @param   SourceSize - I - bytes available at SourceAddr
+ * @param   DestinationAddr - O - decoded pixels
+ * @param   size - I/O - capacity of DestinationAddr on input, bytes decoded on return
+ *
+ * @return  0 = end of image reached
+ *          ERROR_OUT_OF_BOUNDS = stream truncated or decodes past the capacity
+ *
+ */
+{
+    uint32 PixelSize = 3, S = 0, D = 0, capacity = *size, count, bytes;
+    unsigned long long pixel, word0, word1, word2;
+
+    while (S + 2 <= SourceSize)
+    {
+        uint32 ctrl_byte = SourceAddr[S];
+        uint32 color_byte = SourceAddr[S + 1];
+
+        if (ctrl_byte == 0)
+        {
+            if (color_byte == 1)	// End of image
+            {
+                *size = D;
+                return 0;
+            }
+            else if (color_byte == 0)	// End of Line, padded to 32 bits
+            {
+                S = (S + 2 + 3) & ~3u;
+            }
+            else	// literal pixels
+            {
+                bytes = color_byte * PixelSize;
+                S += 2;
+                if (SourceSize - S < bytes || capacity - D < bytes)
+                    return ERROR_OUT_OF_BOUNDS;
+
+                memcpy(DestinationAddr + D, SourceAddr + S, bytes);
+                D += bytes;
+                S += bytes;
+            }
+        }
+        else	// run of one pixel
+        {
+            bytes = ctrl_byte * PixelSize;
+            S++;
+            if (SourceSize - S < PixelSize || capacity - D < bytes)
+                return ERROR_OUT_OF_BOUNDS;
+
+            /* 8 pixels in three 64-bit words (little endian) */
+            pixel = SourceAddr[S] | (SourceAddr[S + 1] << 8) | ((unsigned long long)SourceAddr[S + 2] << 16);
+            word0 = pixel | (pixel << 24) | (pixel << 48);
+            word1 = (pixel >> 16) | (pixel << 8) | (pixel << 32) | (pixel << 56);
+            word2 = (pixel >> 8) | (pixel << 16) | (pixel << 40);
+
+            if (capacity - D >= bytes + 24)
+            {
+                /* away from the end the last store may overshoot, the next code overwrites it */
+                for (count = 0; count < bytes; count += 24)
+                    SPLASH_StorePattern(DestinationAddr + D + count, word0, word1, word2);
+                D += bytes;
+            }
+            else
+            {
+                for (; bytes >= 24; bytes -= 24, D += 24)
+                    SPLASH_StorePattern(DestinationAddr + D, word0, word1, word2);
+                for (; bytes > 0; bytes -= PixelSize, D += PixelSize)
+                    memcpy(DestinationAddr + D, SourceAddr + S, PixelSize);
+            }
+            S += PixelSize;
+        }
+    }
+
+    /* no end of image marker */
+    return ERROR_OUT_OF_BOUNDS;
+}
+
+#if DLPC350_SIMD_X86
+DLPC350_TARGET("ssse3")
+static uint32 SPLASH_SwapGB_SSSE3(unsigned char *pPixels, uint32 numPixels)
+{
+    /* 5 pixels per 16 byte load, the 16th byte is left as is and picked up by the next load */
+    const __m128i mask = _mm_setr_epi8(0, 2, 1, 3, 5, 4, 6, 8, 7, 9, 11, 10, 12, 14, 13, 15);
+    uint32 i;
+
+    for (i = 0; i + 6 <= numPixels; i += 5)
+    {
+        __m128i data = _mm_loadu_si128((const __m128i *)(pPixels + i * 3));
+        _mm_storeu_si128((__m128i *)(pPixels + i * 3), _mm_shuffle_epi8(data, mask));
+    }
+
+    return i;
+}
+#endif
+
+#if DLPC350_SIMD_X86
+DLPC350_TARGET("ssse3")
+static uint32 SPLASH_CopySwapGB_SSSE3(const unsigned char *pSource, unsigned char *pDest, uint32 numPixels)
+{
+    /* SPLASH_SwapGB_SSSE3 into another buffer, the overlapping 16th byte is rewritten unchanged */
+    const __m128i mask = _mm_setr_epi8(0, 2, 1, 3, 5, 4, 6, 8, 7, 9, 11, 10, 12, 14, 13, 15);
+    uint32 i;
+
+    for (i = 0; i + 6 <= numPixels; i += 5)
+    {
+        __m128i data = _mm_loadu_si128((const __m128i *)(pSource + i * 3));
+        _mm_storeu_si128((__m128i *)(pDest + i * 3), _mm_shuffle_epi8(data, mask));
+    }
+
+    return i;
+}
+#endif
+
+/* DLPC350_SwapGB from pSource into pDest */
+static void SPLASH_CopySwapGB(const unsigned char *pSource, unsigned char *pDest, uint32 numPixels)
+{
+    uint32 i = 0;
+
+#if DLPC350_SIMD_X86
+    if (DLPC350_CpuFeatures() & CPU_FEATURE_SSSE3)
+        i = SPLASH_CopySwapGB_SSSE3(pSource, pDest, numPixels);
+#endif
+
+    for (; i < numPixels; i++)
+    {
+        pDest[i * 3 + 0] = pSource[i * 3 + 0];
+        pDest[i * 3 + 1] = pSource[i * 3 + 2];
+        pDest[i * 3 + 2] = pSource[i * 3 + 1];
+    }
+}
+
+void DLPC350_SwapGB(unsigned char *pPixels, uint32 numPixels)
+/**
+ * Swaps the second and third byte of each 3 byte pixel in place, converting between the
+ * BMP order and the splash order.
+ *
+ * @param   pPixels - I/O - packed 24 bit pixels
+ * @param   numPixels - I - number of pixels
+ *
+ */
+{
+    uint32 i = 0;
+
+#if DLPC350_SIMD_X86
+    if (DLPC350_CpuFeatures() & CPU_FEATURE_SSSE3)
+        i = SPLASH_SwapGB_SSSE3(pPixels, numPixels);
+#endif
+
+    for (; i < numPixels; i++)
+    {
+        unsigned char tempByte = pPixels[i * 3 + 2];
+        pPixels[i * 3 + 2] = pPixels[i * 3 + 1];
+        pPixels[i * 3 + 1] = tempByte;
+    }
+}
+
+/* Calls body(0..count-1) on up to numThreads threads (0 = one per core), each taking the next index */
+static void SPLASH_ParallelFor(int count, int numThreads, const std::function<void(int)> &body)
+{
+    std::atomic<int> next(0);
+    std::vector<std::thread> workers;
+    int i;
+
+    if (numThreads <= 0)
+        numThreads = MAX((int)std::thread::hardware_concurrency(), 1);
+    numThreads = MIN(numThreads, count);
+
+    auto worker = [&]()
+    {
+        int index;
+
+        while ((index = next++) < count)
+            body(index);
+    };
+
+    for (i = 1; i < numThreads; i++)
+        workers.push_back(std::thread(worker));
+    worker();
+    for (i = 0; i < (int)workers.size(); i++)
+        workers[i].join();
+}
+
+static int PATTERN_CodeBits(int extent)
+/**
+ * Bits needed to code every column or row, ceil(log2(extent)) and at least 1.
+ */
+{
+    int codeBits = 1;
+
+    while ((1 << codeBits) < extent)
+        codeBits++;
+
+    return codeBits;
+}
+
+static int PATTERN_NumBits(const PATTERN_SET *pSet, int extent)
+/**
+ * Bit planes of a binary or Gray code set: numPatterns, or enough to code every column or row.
+ */
+{
+    if (pSet->numPatterns > 0)
+        return pSet->numPatterns;
+
+    return PATTERN_CodeBits(extent);
+}
+
+static void PATTERN_CodeWords(const PATTERN_SET *pSet, int numBits, int image, int start, int extent, uint32 *pWords)
+/**
+ * Computes the 24 bit pixel of image `image` for coordinates start..extent-1 along the coded axis.
+ * Bit s of a binary or Gray code pixel is plane 24 * image + s. Plane k is bit
+ * PATTERN_CodeBits(extent) - 1 - k of the code, so plane 0 always has the widest stripes;
+ * planes past the least significant bit are dark.
+ * Byte c of a phase shift pixel is step 3 * image + c.
+ */
+{
+    const double twoPi = 6.283185307179586;
+    int topBit = PATTERN_CodeBits(extent) - 1;
+    int x, s, c;
+
+    for (x = start; x < extent; x++)
+        pWords[x] = 0;
+
+    if (pSet->family == PATTERN_PHASE_SHIFT)
+    {
+        for (c = 0; c < 3 && 3 * image + c < pSet->numPatterns; c++)
+        {
+            double shift = twoPi * (3 * image + c) / pSet->numPatterns;
+
+            for (x = start; x < extent; x++)
+            {
+                double value = 127.5 + 127.5 * cos(twoPi * x / pSet->period + shift);
+                pWords[x] |= (uint32)floor(value + 0.5) << (8 * c);
+            }
+        }
+        return;
+    }
+
+    for (x = start; x < extent; x++)
+    {
+        uint32 code = (pSet->family == PATTERN_GRAY_CODE) ? x ^ (x >> 1) : x;
+
+        for (s = 0; s < 24 && 24 * image + s < numBits && 24 * image + s <= topBit; s++)
+            pWords[x] |= ((code >> (topBit - (24 * image + s))) & 1) << s;
+    }
+}
+
+static void PATTERN_PackRow(const uint32 *pWords, int start, int width, unsigned char *pRow)
+/**
+ * Writes 24 bit pixels in splash byte order, bits 16-23 first and bits 0-7 (G0..G7) last.
+ */
+{
+    int x;
+
+    for (x = start; x < width; x++)
+    {
+        pRow[3 * x + 0] = (unsigned char)(pWords[x] >> 16);
+        pRow[3 * x + 1] = (unsigned char)(pWords[x] >> 8);
+        pRow[3 * x + 2] = (unsigned char)pWords[x];
+    }
+}
+
+#if DLPC350_SIMD_X86
+DLPC350_TARGET("avx2")
+static int PATTERN_CodeWordsAVX2(const PATTERN_SET *pSet, int numBits, int image, int extent, uint32 *pWords)
+/**
+ * Binary and Gray code part of PATTERN_CodeWords, 8 coordinates at a time. Returns the
+ * coordinates done.
+ */
+{
+    const __m256i one = _mm256_set1_epi32(1);
+    __m256i coord = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    int numPlanes = MIN(24, MIN(numBits, PATTERN_CodeBits(extent)) - 24 * image);
+    int topBit = PATTERN_CodeBits(extent) - 1 - 24 * image;
+    int x, s;
+
+    for (x = 0; x + 8 <= extent; x += 8)
+    {
+        __m256i code = coord, word = _mm256_setzero_si256();
+
+        if (pSet->family == PATTERN_GRAY_CODE)
+            code = _mm256_xor_si256(code, _mm256_srli_epi32(code, 1));
+
+        for (s = 0; s < numPlanes; s++)
+        {
+            __m256i bit = _mm256_and_si256(_mm256_srl_epi32(code, _mm_cvtsi32_si128(topBit - s)), one);
+            word = _mm256_or_si256(word, _mm256_sll_epi32(bit, _mm_cvtsi32_si128(s)));
+        }
+
+        _mm256_storeu_si256((__m256i *)(pWords + x), word);
+        coord = _mm256_add_epi32(coord, _mm256_set1_epi32(8));
+    }
+
+    return x;
+}
+
+DLPC350_TARGET("avx2")
+static int PATTERN_PackRowAVX2(const uint32 *pWords, int width, unsigned char *pRow)
+/**
+ * PATTERN_PackRow 8 pixels at a time. Returns the pixels done.
+ */
+{
+    const __m256i order = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                           2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const __m256i join = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+    int x;
+
+    for (x = 0; x + 8 <= width; x += 8)
+    {
+        __m256i pixels = _mm256_loadu_si256((const __m256i *)(pWords + x));
+
+        pixels = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(pixels, order), join);
+        _mm_storeu_si128((__m128i *)(pRow + 3 * x), _mm256_castsi256_si128(pixels));
+        _mm_storel_epi64((__m128i *)(pRow + 3 * x + 16), _mm256_extracti128_si256(pixels, 1));
+    }
+
+    return x;
+}
+#endif
+
+int DLPC350_Frmw_GetPatternImageCount(const PATTERN_SET *pSet, int width, int height)
+/**
+ * Number of 24 bit images a pattern set takes.
+ *
+ * @param   pSet - I - pattern family and parameters
+ * @param   width, height - I - DMD resolution
+ *
+ * @return  >0 = number of images
+ *          ERROR_WRONG_PARAMS
+ *
+ */
+{
+    if (pSet == NULL || width <= 0 || height <= 0 || width > 0xFFFF || height > 0xFFFF)
+        return ERROR_WRONG_PARAMS;
+
+    switch (pSet->family)
+    {
+    case PATTERN_BINARY:
+    case PATTERN_GRAY_CODE:
+        if (pSet->numPatterns < 0 || pSet->numPatterns > 31)
+            return ERROR_WRONG_PARAMS;
+        return (PATTERN_NumBits(pSet, pSet->horizontal ? height : width) + 23) / 24;
+
+    case PATTERN_PHASE_SHIFT:
+        if (pSet->numPatterns <= 0 || pSet->period <= 0)
+            return ERROR_WRONG_PARAMS;
+        return (pSet->numPatterns + 2) / 3;
+    }
+
+    return ERROR_WRONG_PARAMS;
+}
+
+int DLPC350_Frmw_RenderPatterns(const PATTERN_SET *pSet, int width, int height, unsigned char **ppImages, int numThreads)
+/**
+ * Renders a structured light pattern set into images in splash layout, ready for
+ * DLPC350_Frmw_SPLASH_AddSplashPixels. The rows along the coded axis are computed once,
+ * the other rows are copies, spread over numThreads threads (0 = one per core).
+ *
+ * @param   pSet - I - pattern family and parameters
+ * @param   width, height - I - DMD resolution
+ * @param   ppImages - O - DLPC350_Frmw_GetPatternImageCount buffers of
+ *                         height * ((width * 3 + 3) & ~3) bytes each
+ *
+ * @return  >0 = number of images rendered
+ *          ERROR_WRONG_PARAMS
+ *
+ */
+{
+    std::vector<std::vector<uint32> > words;
+    int numImages, numBits, extent, lineLength, numBlocks, i;
+
+    numImages = DLPC350_Frmw_GetPatternImageCount(pSet, width, height);
+    if (numImages < 0)
+        return numImages;
+    if (ppImages == NULL)
+        return ERROR_WRONG_PARAMS;
+    for (i = 0; i < numImages; i++)
+    {
+        if (ppImages[i] == NULL)
+            return ERROR_WRONG_PARAMS;
+    }
+
+    extent = pSet->horizontal ? height : width;
+    numBits = PATTERN_NumBits(pSet, extent);
+    lineLength = (width * 3 + 3) & ~3;
+    numBlocks = (height + PATTERN_ROWS_PER_TASK - 1) / PATTERN_ROWS_PER_TASK;
+    words.resize(numImages);
+
+    /* pixels along the coded axis; for vertical stripes that is the first row */
+    SPLASH_ParallelFor(numImages, numThreads, [&](int image)
+    {
+        uint32 *pWords;
+        int done = 0;
+
+        words[image].resize(extent);
+        pWords = &words[image][0];
+
+#if DLPC350_SIMD_X86
+        if (pSet->family != PATTERN_PHASE_SHIFT && (DLPC350_CpuFeatures() & CPU_FEATURE_AVX2))
+            done = PATTERN_CodeWordsAVX2(pSet, numBits, image, extent, pWords);
+#endif
+        PATTERN_CodeWords(pSet, numBits, image, done, extent, pWords);
+
+        if (!pSet->horizontal)
+        {
+            done = 0;
+#if DLPC350_SIMD_X86
+            if (DLPC350_CpuFeatures() & CPU_FEATURE_AVX2)
+                done = PATTERN_PackRowAVX2(pWords, width, ppImages[image]);
+#endif
+            PATTERN_PackRow(pWords, done, width, ppImages[image]);
+            memset(ppImages[image] + width * 3, 0, lineLength - width * 3);
+        }
+    });
+
+    /* the remaining rows, in blocks */
+    SPLASH_ParallelFor(numImages * numBlocks, numThreads, [&](int task)
+    {
+        int image = task / numBlocks;
+        int y = (task % numBlocks) * PATTERN_ROWS_PER_TASK;
+        int end = MIN(y + PATTERN_ROWS_PER_TASK, height);
+        unsigned char *pImage = ppImages[image];
+
+        for (; y < end; y++)
+        {
+            unsigned char *pRow = pImage + y * lineLength;
+            int n;
+
+            if (!pSet->horizontal)
+            {
+                if (y > 0)
+                    memcpy(pRow, pImage, lineLength);
+                continue;
+            }
+
+            /* one colour per row, doubled up to the row length */
+            PATTERN_PackRow(&words[image][y], 0, 1, pRow);
+            for (n = 3; n < width * 3; n *= 2)
+                memcpy(pRow + n, pRow, MIN(n, width * 3 - n));
+            memset(pRow + width * 3, 0, lineLength - width * 3);
+        }
+    });
+
+    return numImages;
+}
+
+static void SPLASH_FreeEncoded(SPLASH_ENCODED *pEncoded)
+{
+    free(pEncoded->pBitmap);
+    free(pEncoded->pRle);
+    pEncoded->pBitmap = NULL;
+    pEncoded->pRle = NULL;
+    pEncoded->pData = NULL;
+}
+
+static inline unsigned long long SPLASH_RotateLeft(unsigned long long value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static inline unsigned long long SPLASH_HashFinish(unsigned long long hash)
+{
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+#define SPLASH_HASH_PRIME1  0x9E3779B185EBCA87ULL
+#define SPLASH_HASH_PRIME2  0xC2B2AE3D27D4EB4FULL
+
+static void SPLASH_HashInit(unsigned long long lane[4])
+{
+    lane[0] = SPLASH_HASH_PRIME1;
+    lane[1] = SPLASH_HASH_PRIME2;
+    lane[2] = ~SPLASH_HASH_PRIME1;
+    lane[3] = ~SPLASH_HASH_PRIME2;
+}
+
+/* Adds numRows rows to the hash, each row on its own so rows can come in blocks. The row
+ * padding is included: the RLE encoder reads rows width * 3 bytes apart, so it shows up in
+ * the stream of images whose rows are padded. */
+static void SPLASH_HashRows(unsigned long long lane[4], const unsigned char *pImage, int width, int numRows)
+{
+    uint32 lineLength = (width * 3 + 3) & ~3;
+    uint32 rowBytes = lineLength, i;
+    unsigned long long word;
+    int y, k;
+
+    for (y = 0; y < numRows; y++)
+    {
+        const unsigned char *pRow = pImage + y * lineLength;
+
+        /* four independent multiply chains keep the multiplier busy */
+        for (i = 0; i + 32 <= rowBytes; i += 32)
+        {
+            for (k = 0; k < 4; k++)
+            {
+                memcpy(&word, pRow + i + 8 * k, sizeof(word));
+                lane[k] = SPLASH_RotateLeft(lane[k] + word * SPLASH_HASH_PRIME2, 31) * SPLASH_HASH_PRIME1;
+            }
+        }
+        for (k = 0; i < rowBytes; i += 8, k++)
+        {
+            word = 0;
+            memcpy(&word, pRow + i, MIN(8, rowBytes - i));
+            lane[k] = SPLASH_RotateLeft(lane[k] + word * SPLASH_HASH_PRIME2, 31) * SPLASH_HASH_PRIME1;
+        }
+    }
+}
+
+static void SPLASH_HashKey(const unsigned long long lane[4], int width, int height, uint8 compression, SPLASH_STORED *pKey)
+{
+    pKey->hash[0] = SPLASH_HashFinish(lane[0] + SPLASH_RotateLeft(lane[1], 7) + SPLASH_RotateLeft(lane[2], 12) + SPLASH_RotateLeft(lane[3], 18));
+    pKey->hash[1] = SPLASH_HashFinish((lane[0] * SPLASH_HASH_PRIME2) ^ (lane[1] * SPLASH_HASH_PRIME1) ^
+                                      SPLASH_RotateLeft(lane[2], 29) ^ SPLASH_RotateLeft(lane[3], 41));
+    pKey->width = (uint16)width;
+    pKey->height = (uint16)height;
+    pKey->requested = (compression == 0 || compression == 1 || compression == 4) ? compression : SPLASH_NOCOMP_SPECIFIED;
+}
+
+static void SPLASH_MakeKey(const unsigned char *bitmapImage, int width, int height, uint8 compression, SPLASH_STORED *pKey)
+/**
+ * Fills the content part of a SPLASH_STORED: a 128 bit hash of an image in splash layout,
+ * its size and the requested compression. Images with equal keys encode to the same splash.
+ */
+{
+    unsigned long long lane[4];
+
+    SPLASH_HashInit(lane);
+    SPLASH_HashRows(lane, bitmapImage, width, height);
+    SPLASH_HashKey(lane, width, height, compression, pKey);
+}
+
+static bool SPLASH_SameContent(const SPLASH_STORED *a, const SPLASH_STORED *b)
+{
+    return a->hash[0] == b->hash[0] && a->hash[1] == b->hash[1] && a->width == b->width &&
+           a->height == b->height && a->requested == b->requested;
+}
+
+static int SPLASH_LoadImage(const unsigned char *pImageBuffer, uint8 compression, unsigned char **ppImage,
+                            int *pWidth, int *pHeight, SPLASH_STORED *pKey)
+/**
+ * Flips and swizzles one BMP into splash layout and hashes it as SPLASH_MakeKey does. Each
+ * row is read from the BMP once and written once; the rows are hashed in small blocks while
+ * still in cache. Touches no shared state, so several images can be loaded at once.
+ *
+ * @param   pImageBuffer - I - BMP file contents
+ * @param   compression - I - requested compression, part of the key
+ * @param   ppImage - O - pixels for SPLASH_EncodeSplash, release with free()
+ * @param   pWidth, pHeight - O - image size
+ * @param   pKey - O - content key
+ *
+ * @return  0 = SUCCESS
+ *          ERROR_NOT_BMP_FILE, ERROR_NOT_24bit_BMP_FILE, ERROR_NO_MEM_FOR_MALLOC
+ *
+ */
+{
+    BITMAPINFOHEADER headerInfo;
+    const unsigned char *pSource;
+    unsigned char *bitmapImage;
+    unsigned long long lane[4];
+    int lineLength, width, height, block, y;
+    unsigned short bfType;
+    unsigned int bfOffBits;
+
+    memcpy(&bfType, pImageBuffer, sizeof(bfType));
+    memcpy(&bfOffBits, pImageBuffer + 3*sizeof(bfType) + sizeof(uint32), sizeof(bfOffBits));
+    memcpy(&headerInfo, pImageBuffer + BMP_FILE_HEADER_SIZE, sizeof(headerInfo));
+
+    if (bfType != 0x4D42)
+        return ERROR_NOT_BMP_FILE;
+    if(headerInfo.biBitCount != 24)// && headerInfo.biBitCount != 32)
+    {
+        return ERROR_NOT_24bit_BMP_FILE;
+    }
+
+    width = headerInfo.biWidth;
+    height = headerInfo.biHeight;
+    lineLength = (width * 3 + 3) & ~3;
+
+    bitmapImage = (unsigned char *)malloc(lineLength * height);
+    if (!bitmapImage)
+        return ERROR_NO_MEM_FOR_MALLOC;
+
+    pSource = pImageBuffer + bfOffBits;
+    SPLASH_HashInit(lane);
+
+    /* BMP rows are bottom up, splash rows top down; the padding is kept as it is. Every row is
+     * G/B swapped, including the middle row of an odd height, which the old pairwise flip missed */
+    for (block = 0; block < height; block += SPLASH_LOAD_BLOCK_ROWS)
+    {
+        int numRows = MIN(SPLASH_LOAD_BLOCK_ROWS, height - block);
+
+        for (y = block; y < block + numRows; y++)
+        {
+            const unsigned char *pSourceRow = pSource + lineLength * (height - 1 - y);
+            unsigned char *pRow = bitmapImage + lineLength * y;
+
+            SPLASH_CopySwapGB(pSourceRow, pRow, width);
+            memcpy(pRow + width * 3, pSourceRow + width * 3, lineLength - width * 3);
+        }
+
+        SPLASH_HashRows(lane, bitmapImage + lineLength * block, width, numRows);
+    }
+
+    SPLASH_HashKey(lane, width, height, compression, pKey);
+
+    *ppImage = bitmapImage;
+    *pWidth = width;
+    *pHeight = height;
+    return 0;
+}
+
+static int SPLASH_EncodeSplash(const unsigned char *bitmapImage, unsigned char *ownedImage, int width, int height,
+                               uint8 *compression, SPLASH_ENCODED *pEncoded)
+/**
+ * Compresses an image already in splash layout into a splash header and data.
+ *
+ * @param   bitmapImage - I - top row first, rows padded to 4 bytes, G and B swapped
+ * @param   ownedImage - I - bitmapImage if it was allocated for this splash and is released
+ *                           with it, NULL if it belongs to the caller
+ * @param   compression - I/O - requested compression, the one used on return
+ * @param   pEncoded - O - header and data, release with SPLASH_FreeEncoded
+ *
+ * @return  0 = SUCCESS
+ *          ERROR_NO_MEM_FOR_MALLOC
+ *
+ */
+{
+    const unsigned char *splashImage;
+    unsigned char *rleBuffer;
+    uint32 rleCompSize, splashSize;
+    int lineLength, period, rlePeriod;
+
+    memset(pEncoded, 0, sizeof(*pEncoded));
+
+    lineLength = (width * 3 + 3) & ~3;
+
+    rleBuffer = (unsigned char *)malloc(SPLASH_RLE_MAX_SIZE(width, height));
+
+    if (rleBuffer == NULL)
+    {
+        free(ownedImage);
+        return ERROR_NO_MEM_FOR_MALLOC;
+    }
+
+    /* rows that repeat every 1, 2 or 4 lines fit the 4 line format, any period shortens RLE */
+    period = (*compression == 0 || *compression == 4) ? 0 :
+             SPLASH_FindLinePeriod(bitmapImage, width, height, lineLength);
+    rlePeriod = (lineLength == width * 3) ? period : 0;
+
+    switch(*compression)
+    {
+    case 0: // force uncompress
+        splashSize  = height * lineLength;
+        splashImage = bitmapImage;
+        break;
+
+    case 1: // force rle compress
+        SPLASH_PerformRLECompressionPeriodic(bitmapImage, rleBuffer, width, height, rlePeriod, &splashSize);
+        splashImage = rleBuffer;
+        break;
+
+    case 4: // force 4 line compress
+        splashSize  = 4 * lineLength;
+        splashImage = bitmapImage;
+        break;
+
+    default: // auto compression
+
+        splashSize  = height * lineLength;
+
+        if(period != 0 && period <= 4 && (uint32)(4 * lineLength) < splashSize)
+        {
+            splashSize  = 4 * lineLength;
+            splashImage = bitmapImage;
+            *compression = 4;
+        }
+        else if(SPLASH_EstimateRLESize(bitmapImage, width, height) > splashSize + splashSize / 8)
+        {
+            /* the sampled rows say RLE clearly loses, skip the full encode */
+            splashImage = bitmapImage;
+            *compression    = 0;
+        }
+        else
+        {
+            SPLASH_PerformRLECompressionPeriodic(bitmapImage, rleBuffer, width, height, rlePeriod, &rleCompSize);
+
+            if(rleCompSize < splashSize)
+            {
+                splashSize  = rleCompSize;
+                splashImage = rleBuffer;
+                *compression    = 1;
+            }
+            else
+            {
+                splashImage = bitmapImage;
+                *compression    = 0;
+            }
+        }
+
+        break;
+    }
+
+    pEncoded->header.Signature		= 0x636C7053;
+    pEncoded->header.Image_width	= (uint16)width;
+    pEncoded->header.Image_height	= (uint16)height;
+    pEncoded->header.Pixel_format	= 1; // 24-bit packed
+    pEncoded->header.Subimg_offset = -1;
+    pEncoded->header.Subimg_end	= -1;
+    pEncoded->header.Bg_color		= 0;
+    pEncoded->header.ByteOrder		= 1;
+    pEncoded->header.ChromaOrder	= 0;
+    pEncoded->header.Byte_count	= splashSize;
+    pEncoded->header.Compression	= *compression;
+
+    /* release the buffer that was not chosen, batches keep many encoded images alive */
+    if (splashImage == rleBuffer)
+    {
+        free(ownedImage);
+        ownedImage = NULL;
+    }
+    else
+    {
+        free(rleBuffer);
+        rleBuffer = NULL;
+    }
+
+    pEncoded->pBitmap = ownedImage;
+    pEncoded->pRle = rleBuffer;
+    pEncoded->pData = splashImage;
+    pEncoded->size = splashSize;
+
+    return 0;
+}
+
+int DLPC350_Frmw_BenchmarkRLE(const unsigned char *pImage, int width, int height, int iterations, double *pReferenceMs, double *pVectorMs)
+/**
+ * Encodes a packed 24 bit image with the reference and the vectorized RLE encoder, times both
+ * and compares their output byte for byte.
+ *
+ * @param   pImage - I - width * height pixels, 3 bytes each, rows not padded
+ * @param   iterations - I - number of times each encoder is run
+ * @param   pReferenceMs - O - mean time of the reference encoder in milliseconds
+ * @param   pVectorMs - O - mean time of the vectorized encoder in milliseconds
+ *
+ * @return  0 = streams identical
+ *          ERROR_RLE_MISMATCH = streams differ
+ *          ERROR_WRONG_PARAMS, ERROR_NO_MEM_FOR_MALLOC
+ *
+ */
+{
+    unsigned char *refBuffer, *vecBuffer;
+    uint32 maxSize, refSize = 0, vecSize = 0;
+    int i, ret = 0;
+
+    if (pImage == NULL || width <= 0 || height <= 0 || iterations <= 0)
+        return ERROR_WRONG_PARAMS;
+
+    maxSize = SPLASH_RLE_MAX_SIZE(width, height);
+    refBuffer = (unsigned char *)malloc(maxSize);
+    vecBuffer = (unsigned char *)malloc(maxSize);
+    if (refBuffer == NULL || vecBuffer == NULL)
+    {
+        free(refBuffer);
+        free(vecBuffer);
+        return ERROR_NO_MEM_FOR_MALLOC;
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (i = 0; i < iterations; i++)
+        SPLASH_PerformRLECompressionReference(pImage, refBuffer, width, height, &refSize);
+    std::chrono::steady_clock::time_point middle = std::chrono::steady_clock::now();
+    for (i = 0; i < iterations; i++)
+        SPLASH_PerformRLECompression(pImage, vecBuffer, width, height, &vecSize);
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    if (pReferenceMs)
+        *pReferenceMs = std::chrono::duration<double, std::milli>(middle - start).count() / iterations;
+    if (pVectorMs)
+        *pVectorMs = std::chrono::duration<double, std::milli>(end - middle).count() / iterations;
+
+    if (refSize != vecSize || memcmp(refBuffer, vecBuffer, refSize) != 0)
+        ret = ERROR_RLE_MISMATCH;
+
+    free(refBuffer);
+    free(vecBuffer);
+
+    return ret;
+}
+
+int DLPC350_Frmw_LocateFlashTable(const unsigned char *pByteArray, uint32 size, uint32 *pTableAddress)
+/**
+ * Probes the known flash table offsets (0x20000, then 0x8000) of a firmware image.
+ *
+ * @param   pByteArray - I - firmware image
+ * @param   size - I - size of the image in bytes
+ * @param   pTableAddress - O - offset of the flash table in the image
+ *
+ * @return  0 = PASS
+ *          ERROR_FRMW_FLASH_TABLE_SIGN_MISMATCH = no flash table found
+ *
+ */
+{
+    const uint32 probeAddress[] = { 0x00020000, 0x00008000 };
+    uint32 i, signature;
+
+    for (i = 0; i < ARRAY_SIZE(probeAddress); i++)
+    {
+        if (probeAddress[i] + sizeof(FLASH_TABLE) > size)
+            continue;
+
+        memcpy(&signature, pByteArray + probeAddress[i], sizeof(signature));
+        if (signature == FLASHTABLE_APP_SIGNATURE)
+        {
+            *pTableAddress = probeAddress[i];
+            return 0;
+        }
+    }
+
+    return ERROR_FRMW_FLASH_TABLE_SIGN_MISMATCH;
+}
+
+SplashBuilder::SplashBuilder() :
+    splBuffer(NULL), splash_index(0), splash_capacity(0), splash_count(0), splash_data_start_flash_address(0), numStored(0)
+{
+    ChipSelectSize[0] = 0x00000000;  // LightCrafter 4500 does not have third chip
+    ChipSelectSize[1] = 0x01000000;
+    ChipSelectSize[2] = 0x01000000;
+    ChipSelectEnd[0] = 0xFC000000;
+    ChipSelectEnd[1] = 0xFA000000;
+    ChipSelectEnd[2] = 0xFB000000;
+    ChipSelectBase[0] = 0xFB000000;
+    ChipSelectBase[1] = 0xF9000000;
+    ChipSelectBase[2] = 0xFA000000;
+}
+
+SplashBuilder::~SplashBuilder()
+{
+    free(splBuffer);
+}
+
+void SplashBuilder::SetChipSelectSize(int chipSelect, uint32 size)
+{
+    if (chipSelect >= 0 && chipSelect < 3)
+        ChipSelectSize[chipSelect] = size;
+}
+
+/**
+ * Decodes one splash into pImageBuffer, width * height * 3 bytes, swapping it back to B, G, R.
+ */
+static int SPLASH_DecodeSplash(const SPLASH_HEADER *pHeader, const unsigned char *splash_data, uint32 splash_image_size,
+                               unsigned char *pImageBuffer)
+{
+    uint32 image_size, offset;
+
+    image_size = pHeader->Image_width * pHeader->Image_height * 3; // We only support 24 bit format.
+
+    /* Decode straight from the image into the caller's buffer */
+    if (pHeader->Compression == SPLASH_4LINE_COMPRESSION)
+    {
+        for (offset = 0; offset < image_size; offset += pHeader->Image_width * 3 * 4)
+            memcpy(pImageBuffer + offset, splash_data, MIN(splash_image_size, image_size - offset));
+    }
+    else if (pHeader->Compression == SPLASH_RLE_COMPRESSION)
+    {
+        uint32 decoded_size = image_size;
+
+        if (SPLASH_PerformRLEUnCompression(splash_data, splash_image_size, pImageBuffer, &decoded_size) < 0)
+            return ERROR_OUT_OF_BOUNDS;
+        memset(pImageBuffer + decoded_size, 0, image_size - decoded_size);
+    }
+    else if (pHeader->Compression == SPLASH_UNCOMPRESSED)
+    {
+        memcpy(pImageBuffer, splash_data, MIN(splash_image_size, image_size));
+    }
+
+    DLPC350_SwapGB(pImageBuffer, pHeader->Image_width * pHeader->Image_height);
+
+    return 0;
+}
+
+SplashCache::SplashCache() : usedBytes(0), limitBytes(SPLASH_CACHE_DEFAULT_BYTES)
+{
+}
+
+void SplashCache::SetLimit(size_t maxBytes)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    limitBytes = maxBytes;
+    Trim();
+}
+
+SPLASH_IMAGE SplashCache::Find(uint32 key)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = lookup.find(key);
+
+    if (found == lookup.end())
+        return SPLASH_IMAGE();
+
+    entries.splice(entries.begin(), entries, found->second);
+    return found->second->second;
+}
+
+void SplashCache::Insert(uint32 key, const SPLASH_IMAGE &image)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    /* another thread decoded it first, or it would not fit at all */
+    if (lookup.count(key) || image->pixels.size() > limitBytes)
+        return;
+
+    entries.push_front(std::make_pair(key, image));
+    lookup[key] = entries.begin();
+    usedBytes += image->pixels.size();
+    Trim();
+}
+
+void SplashCache::Clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    entries.clear();
+    lookup.clear();
+    usedBytes = 0;
+}
+
+/* Caller holds the mutex */
+void SplashCache::Trim()
+{
+    while (usedBytes > limitBytes && !entries.empty())
+    {
+        usedBytes -= entries.back().second->pixels.size();
+        lookup.erase(entries.back().first);
+        entries.pop_back();
+    }
+}
+
+FirmwareImage::FirmwareImage() :
+    pFrmwImageArray(NULL), frmwImageSize(0), FLASH_TABLE_ADDRESS(0x00020000),
+    splash_data_start_flash_address(0), appl_config_data_flash_address(0), trigMode(-1), numIniParams(0)
+{
+    firstIniToken[0] = '\0';
+}
+
+FirmwareImage::~FirmwareImage()
+{
+    free(pFrmwImageArray);
+}
+
+int FirmwareImage::SPLASH_InitBuffer(int numSplash)
+{
+    return splash.InitBuffer(splash_data_start_flash_address, numSplash);
+}
+
+int FirmwareImage::SPLASH_AddSplash(unsigned char *pImageBuffer, uint8 *compression, uint32 *compSize)
+{
+    return splash.AddSplash(pImageBuffer, compression, compSize);
+}
+
+int FirmwareImage::SPLASH_AddSplashPixels(const unsigned char *pPixels, int width, int height, uint8 *compression, uint32 *compSize)
+{
+    return splash.AddSplashPixels(pPixels, width, height, compression, compSize);
+}
+
+int FirmwareImage::SPLASH_AddSplashes(unsigned char **ppImageBuffers, int numImages, uint8 *compression, uint32 *compSize, int numThreads)
+{
+    return splash.AddSplashes(ppImageBuffers, numImages, compression, compSize, numThreads);
+}
+
+void FirmwareImage::Get_NewSplashBuffer(unsigned char **newSplashBuffer, uint32 *newSplashSize) const
+{
+    splash.GetBuffer(newSplashBuffer, newSplashSize);
+}
+
+int FirmwareImage::CopyAndVerifyImage(const unsigned char *pByteArray, int size)
+{
+    FLASH_TABLE *flash_table;
+    int ret;
+
+    cache.Clear();
+
+    if (pFrmwImageArray != NULL)
+    {
+        free(pFrmwImageArray);
+        pFrmwImageArray = NULL;
+        frmwImageSize = 0;
+        splash_data_start_flash_address = 0;
+        appl_config_data_flash_address = 0;
+    }
+
+    ret = DLPC350_Frmw_LocateFlashTable(pByteArray, size, &FLASH_TABLE_ADDRESS);
+    if (ret < 0)
+    {
+        FLASH_TABLE_ADDRESS = 0x00020000;
+        return ret;
+    }
+
+    pFrmwImageArray = (unsigned char *)malloc(size);
+    if (pFrmwImageArray == NULL)
+        return ERROR_NO_MEM_FOR_MALLOC;
+
+    memcpy(pFrmwImageArray, pByteArray, size);
+    frmwImageSize = size;
+
+    flash_table = (FLASH_TABLE *)(pFrmwImageArray + FLASH_TABLE_ADDRESS);
+
+    splash_data_start_flash_address = flash_table->Splash_Data[FLASH_TABLE_SPLASH_INDEX].Address;
+    appl_config_data_flash_address = flash_table->APPL_Config_Data[0].Address;
+
+    return 0;
+}
+
+unsigned int FirmwareImage::GetVersionNumber() const
+{
+    uint32 version_number;
+
+    if (!appl_config_data_flash_address)
+        return ERROR_INIT_NOT_DONE_PROPERLY;
+    memcpy(&version_number, pFrmwImageArray + (appl_config_data_flash_address - FLASH_BASE_ADDRESS), sizeof(version_number));
+
+    return version_number;
+}
+
+int FirmwareImage::WriteApplConfigData(char *token, uint32 *params, int numParams)
+{
+    int i;
+    int j;
+    int index = -1;
+    int offset;
+    char toUpperToken[128];
+
+    uint32 appl_config_data_start_address = appl_config_data_flash_address - FLASH_BASE_ADDRESS;
+    uint8 *app_data = (uint8 *)(pFrmwImageArray + appl_config_data_start_address);
+
+    if (!appl_config_data_flash_address)
+        return ERROR_INIT_NOT_DONE_PROPERLY;
+
+    //Convert everything to uppercase for string comparison
+    i = 0;
+    while(token[i] != '\0')
+    {
+        toUpperToken[i] = toupper(token[i]);
+        i++;
+    }
+    toUpperToken[i] = '\0';
+
+    for (index = 0; index < NR_INI_TOKENS; index++)
+        if(strcmp(&g_iniParam_Info[index].token[0],&toUpperToken[0]) == 0)
+            break;
+
+    if (index == NR_INI_TOKENS) //if no match found in the above search
+        return ERROR_WRONG_PARAMS;
+
+    offset = g_iniParam_Info[index].frmw_offset;
+
+    if(strcmp("DEFAULT.PORTCONFIG.CSC",&toUpperToken[0]) == 0)
+    {
+        if(numParams != 9)
+            return ERROR_WRONG_PARAMS;
+
+        for(i = 0; i < 9; i++)
+        {
+            *((uint16*) (app_data + offset)) = (uint16)params[i];
+            offset += 2;
+        }
+    }
+    else if (strcmp("DEFAULT.SPLASHLUT",&toUpperToken[0]) == 0)
+    {
+        //legacy trigger mode
+        if(trigMode >= 0 && trigMode <= 2)
+        {
+            //Legacy pattern sequence maxsize = 64
+            if((numParams < 1) || (numParams > MAX_IMAGE_LUT_ENTRIES))
+                return ERROR_WRONG_PARAMS;
+        }
+        else
+        {
+            //Variable exposure trigger mode
+            if(trigMode > 2 && trigMode <= 4)
+            {
+                //Variable exposure pattern sequence maxsize = 256
+                if((numParams < 1) || (numParams > MAX_VAR_EXP_IMAGE_LUT_ENTRIES))
+                    return ERROR_WRONG_PARAMS;
+            }
+            else
+                return ERROR_WRONG_PARAMS;
+        }
+
+        //Special case for two entries
+        if(numParams == 2)
+        {
+            *((uint8*) (app_data + offset)) = (uint8)params[1];
+            offset ++;
+
+            *((uint8*) (app_data + offset)) = (uint8)params[0];
+            offset ++;
+        }
+        else
+        {
+            for (i = 0; i < numParams; i++)
+            {
+                *((uint8*) (app_data + offset)) = (uint8)params[i];
+                offset ++;
+            }
+        }
+    }
+    else if (strcmp("DEFAULT.SEQPATLUT",&toUpperToken[0]) == 0)
+    {
+
+        //legacy trigger mode
+        if(trigMode >= 0 && trigMode <= 2)
+        {
+            //Legacy pattern sequence maxsize = 128
+            if((numParams < 1) || (numParams > MAX_PAT_LUT_ENTRIES))
+                return ERROR_WRONG_PARAMS;
+
+            //16-BYTES space available per entry
+            for (i = 0; i < numParams; i++)
+            {
+                //BYTE - 3 Rsvd
+                *((uint8*) (app_data + offset)) = (uint8)((params[i] >> 24) & 0xFF);
+                offset ++;
+
+                //BYTE - 0
+                *((uint8*) (app_data + offset)) = (uint8)((params[i] >> 0) & 0xFF);
+                offset ++;
+
+                //BYTE - 1
+                *((uint8*) (app_data + offset)) = (uint8)((params[i] >> 8) & 0xFF);
+                offset ++;
+
+                //BYTE - 2
+                *((uint8*) (app_data + offset)) = (uint8)((params[i] >> 16) & 0xFF);
+                offset ++;
+
+                //fill remaining 12 - bytes with zeros
+                for(j = 0; j < 12; j++)
+                {
+                    *((uint8*) (app_data + offset)) = (uint8) 0x00;
+                    offset ++;
+                }
+            }
+        }
+        else
+        {
+            //Variable exposure trigger mode
+            if(trigMode > 2 && trigMode <= 4)
+            {
+                //Variable exposure pattern sequence maxsize = 1824
+                if((numParams < 1) || (numParams > (MAX_VAR_EXP_PAT_LUT_ENTRIES*3)))
+                    return ERROR_WRONG_PARAMS;
+            }
+            else
+                return ERROR_WRONG_PARAMS;
+
+            //16-BYTES space available per entry - maximum can be 1824x3 32bit params
+            for (i = 0; i < (numParams/3); i++)
+            {
+                //BYTE - 3 Rsvd
+                *((uint8*) (app_data + offset)) = (uint8)((params[i*3] >> 24) & 0xFF);
+                offset ++;
+
+                //BYTE - 0
+                *((uint8*) (app_data + offset)) = (uint8)((params[i*3] >> 0) & 0xFF);
+                offset ++;
+
+                //BYTE - 1
+                *((uint8*) (app_data + offset)) = (uint8)((params[i*3] >> 8) & 0xFF);
+                offset ++;
+
+                //BYTE - 2
+                *((uint8*) (app_data + offset)) = (uint8)((params[i*3] >> 16) & 0xFF);
+                offset ++;
+
+                //Fill Pattern exposure 32-bit information
+                //LSB
+                *((uint8*) (app_data + offset)) = (uint8)((params[i*3+1] >> 0) & 0xFF);
+                offset ++;
+
+                //LSB+1
+                *((uint8*) (app_data + offset)) = (uint8)((params[i*3+1] >> 8) & 0xFF);
+                offset ++;
+
+                //LSB+2
                 *((uint8*) (app_data + offset)) = (uint8)((params[i*3+1] >> 16) & 0xFF);
                 offset ++;
 
@@ -699,7 +1974,7 @@ int DLPC350_Frmw_WriteApplConfigData(char *token, uint32 *params, int numParams)
     return 0;
 }
 
-int DLPC350_Frmw_GetSplashCount()
+int FirmwareImage::GetSplashCount() const
 {
     uint32 splash_data_start_address = splash_data_start_flash_address - FLASH_BASE_ADDRESS;
     SPLASH_SUPER_BINARY_INFO binary_info;
@@ -713,21 +1988,23 @@ int DLPC350_Frmw_GetSplashCount()
         return -1;
 }
 
-unsigned int DLPC350_Frmw_GetSPlashFlashStartAddress()
+unsigned int FirmwareImage::GetSplashFlashStartAddress() const
 {
     return splash_data_start_flash_address;
 }
 
-int DLPC350_Frmw_GetSpashImage(unsigned char *pImageBuffer, int index)
+int FirmwareImage::LocateSplash(int index, SPLASH_HEADER *pHeader, const unsigned char **ppData, uint32 *pSize) const
 {
     SPLASH_BLOB_INFO blob_info;
-    uint32 blob_address, splash_image_address, splash_image_size;
-    SPLASH_HEADER splash_header;
-    unsigned char *image_buffer, *lineData;
-    int i, j, lineLength;
+    uint32 blob_address, splash_image_address;
     uint32 splash_data_start_address = splash_data_start_flash_address - FLASH_BASE_ADDRESS;
 
+    if (pFrmwImageArray == NULL || index < 0)
+        return ERROR_WRONG_PARAMS;
+
     blob_address = splash_data_start_address + sizeof(SPLASH_SUPER_BINARY_INFO) + index * sizeof(blob_info);
+    if (blob_address > frmwImageSize || frmwImageSize - blob_address < sizeof(blob_info))
+        return ERROR_OUT_OF_BOUNDS;
     memcpy(&blob_info, pFrmwImageArray + blob_address, sizeof(blob_info));
 
     if (blob_info.BlobOffset == 0xffffffff)
@@ -739,81 +2016,110 @@ int DLPC350_Frmw_GetSpashImage(unsigned char *pImageBuffer, int index)
     }
 
     splash_image_address = blob_info.BlobOffset - FLASH_BASE_ADDRESS;
-    memcpy(&splash_header, pFrmwImageArray + splash_image_address, sizeof(splash_header));
-    splash_image_address += sizeof(splash_header);
+    if (blob_info.BlobSize < sizeof(SPLASH_HEADER) || splash_image_address > frmwImageSize ||
+        frmwImageSize - splash_image_address < blob_info.BlobSize)
+        return ERROR_OUT_OF_BOUNDS;
 
-    splash_image_size = blob_info.BlobSize - sizeof(splash_header);
+    memcpy(pHeader, pFrmwImageArray + splash_image_address, sizeof(SPLASH_HEADER));
+    *ppData = pFrmwImageArray + splash_image_address + sizeof(SPLASH_HEADER);
+    *pSize = blob_info.BlobSize - sizeof(SPLASH_HEADER);
 
-    if (splash_header.Compression == SPLASH_4LINE_COMPRESSION)
-    {
-        unsigned char *fourLine_buffer;
+    return 0;
+}
 
-        fourLine_buffer = (unsigned char *)malloc(splash_image_size);
-        if(fourLine_buffer == NULL)
-            return ERROR_NO_MEM_FOR_MALLOC;
+int FirmwareImage::GetSplashImageSize(int index, uint16 *pWidth, uint16 *pHeight) const
+{
+    SPLASH_HEADER splash_header;
+    const unsigned char *splash_data;
+    uint32 splash_image_size;
+    int ret;
 
-        memcpy(fourLine_buffer, pFrmwImageArray + splash_image_address, splash_image_size);
+    ret = LocateSplash(index, &splash_header, &splash_data, &splash_image_size);
+    if (ret < 0)
+        return ret;
 
-        image_buffer =  (unsigned char *)malloc(splash_header.Image_width * splash_header.Image_height * 3); // We only support 24 bit format.
-        if(image_buffer == NULL)
-            return ERROR_NO_MEM_FOR_MALLOC;
+    *pWidth = splash_header.Image_width;
+    *pHeight = splash_header.Image_height;
 
-        for (i = 0; i < splash_header.Image_height; i+=4)
-            memcpy((image_buffer + (splash_header.Image_width * 3 * i)), fourLine_buffer, splash_image_size);
+    return 0;
+}
 
-        splash_image_size = splash_header.Image_width * splash_header.Image_height * 3;
-    }
-    else if (splash_header.Compression == SPLASH_RLE_COMPRESSION)
-    {
-        unsigned char* rle_buffer;
+int FirmwareImage::GetSplashImage(unsigned char *pImageBuffer, int index) const
+{
+    SPLASH_IMAGE image;
+    int ret;
 
-        rle_buffer = (unsigned char *)malloc(splash_image_size);
-        if(rle_buffer == NULL)
-            return ERROR_NO_MEM_FOR_MALLOC;
+    ret = GetSplashImageHandle(index, &image);
+    if (ret < 0)
+        return ret;
 
-        image_buffer =  (unsigned char *)malloc(splash_header.Image_width * splash_header.Image_height * 3); // We only support 24 bit format.
-        if(image_buffer == NULL)
-            return ERROR_NO_MEM_FOR_MALLOC;
+    memcpy(pImageBuffer, image->pixels.data(), image->pixels.size());
 
-        memcpy(rle_buffer, pFrmwImageArray + splash_image_address, splash_image_size);
+    return 0;
+}
 
-        SPLASH_PerformRLEUnCompression(rle_buffer, image_buffer, &splash_image_size);
-        free(rle_buffer);
-    }
-    else if (splash_header.Compression == SPLASH_UNCOMPRESSED)
-    {
-        image_buffer = (unsigned char *)malloc(splash_image_size);
-        if(image_buffer == NULL)
-            return ERROR_NO_MEM_FOR_MALLOC;
+int FirmwareImage::GetSplashImageHandle(int index, SPLASH_IMAGE *pImage) const
+{
+    SPLASH_HEADER splash_header;
+    const unsigned char *splash_data;
+    uint32 splash_image_size, key;
+    int ret;
 
-        memcpy(image_buffer, pFrmwImageArray + splash_image_address, splash_image_size);
-    }
+    ret = LocateSplash(index, &splash_header, &splash_data, &splash_image_size);
+    if (ret < 0)
+        return ret;
 
-    lineLength = splash_header.Image_width * 3;
+    /* the header just before the data, so one key per width, height, compression and content */
+    key = (uint32)(splash_data - pFrmwImageArray);
+    *pImage = cache.Find(key);
+    if (*pImage)
+        return 0;
 
-    lineData = (unsigned char *) malloc(lineLength);
-    for (i = 0; i < splash_header.Image_height; i++)
-    {
-        memcpy(lineData, image_buffer + (lineLength * i), lineLength);
-        for (j = 0;j < splash_header.Image_width; j++)
-        {
-            unsigned char tempByte;
+    std::shared_ptr<SPLASH_DECODED> decoded = std::make_shared<SPLASH_DECODED>();
+    decoded->width = splash_header.Image_width;
+    decoded->height = splash_header.Image_height;
+    decoded->pixels.resize((size_t)decoded->width * decoded->height * 3);
 
-            tempByte = lineData[j * 3 + 2];
-            lineData[j * 3 + 2] = lineData[j * 3 + 1];
-            lineData[j * 3 + 1] = tempByte;
-        }
-        memcpy(image_buffer + (lineLength * i), lineData, lineLength);
-    }
+    ret = SPLASH_DecodeSplash(&splash_header, splash_data, splash_image_size, decoded->pixels.data());
+    if (ret < 0)
+        return ret;
 
-    free(lineData);
-    memcpy(pImageBuffer, image_buffer, splash_image_size);
-    free(image_buffer);
+    *pImage = decoded;
+    cache.Insert(key, *pImage);
 
     return 0;
 }
 
-int DLPC350_Frmw_SPLASH_InitBuffer(int numSplash)
+int FirmwareImage::GetSplashImages(unsigned char **ppImageBuffers, int numImages, int numThreads) const
+{
+    std::atomic<int> result(0);
+
+    if (ppImageBuffers == NULL || numImages < 0 || numImages > GetSplashCount())
+        return ERROR_WRONG_PARAMS;
+
+    /* a failed image does not stop the others */
+    SPLASH_ParallelFor(numImages, numThreads, [&](int index)
+    {
+        int ret, expected = 0;
+
+        if (ppImageBuffers[index] == NULL)
+            return;
+
+        SPLASH_HEADER splash_header;
+        const unsigned char *splash_data;
+        uint32 splash_image_size;
+
+        ret = LocateSplash(index, &splash_header, &splash_data, &splash_image_size);
+        if (ret == 0)
+            ret = SPLASH_DecodeSplash(&splash_header, splash_data, splash_image_size, ppImageBuffers[index]);
+        if (ret < 0)
+            result.compare_exchange_strong(expected, ret);
+    });
+
+    return result;
+}
+
+int SplashBuilder::InitBuffer(uint32 splashStartAddress, int numSplash)
 {
     SPLASH_SUPER_BINARY_INFO	binary_info;
     SPLASH_BLOB_INFO		blob_info;
@@ -826,6 +2132,8 @@ int DLPC350_Frmw_SPLASH_InitBuffer(int numSplash)
     }
     splash_index = 0;
     splash_count = 0;
+    numStored = 0;
+    splash_data_start_flash_address = splashStartAddress;
 
     binary_info.Sig1 = 0x12345678;
     binary_info.Sig2 = 0x87654321;
@@ -834,7 +2142,13 @@ int DLPC350_Frmw_SPLASH_InitBuffer(int numSplash)
     blob_info.BlobOffset = 0xFFFFFFFF;
     blob_info.BlobSize   = 0xFFFFFFFF;
 
-    splBuffer = (unsigned char *) malloc(sizeof(binary_info) + (sizeof(blob_info) * numSplash));
+    splash_capacity = sizeof(binary_info) + (sizeof(blob_info) * numSplash);
+    splBuffer = (unsigned char *) malloc(splash_capacity);
+    if (splBuffer == NULL)
+    {
+        splash_capacity = 0;
+        return ERROR_NO_MEM_FOR_MALLOC;
+    }
 
     memcpy(splBuffer + splash_index, &binary_info, sizeof(binary_info));
     splash_index += sizeof(binary_info);
@@ -847,268 +2161,424 @@ int DLPC350_Frmw_SPLASH_InitBuffer(int numSplash)
     return 0;
 }
 
-int DLPC350_Frmw_SPLASH_AddSplash(unsigned char *pImageBuffer, uint8 *compression, uint32 *compSize)
+int SplashBuilder::Reserve(uint32 size)
 {
-    uint32 lineCompSize, rleCompSize;
+    unsigned char *buffer;
+    uint32 capacity;
 
-    BITMAPINFOHEADER headerInfo;
-    unsigned char *bitmapImage, *line1Data, *line2Data, *splashImage;
-    int lineLength, bytesPerPixel, i, j;
-    uint32 splashSize;
-    SPLASH_HEADER splash_header;
-    SPLASH_BLOB_INFO *blob_info;
-    unsigned short bfType;
-    unsigned int bfSize, bfOffBits;
+    if (size <= splash_capacity)
+        return 0;
 
-    if((!splBuffer || !splash_data_start_flash_address))
-        return ERROR_INIT_NOT_DONE_PROPERLY;
+    /* grow geometrically so that adding splashes one by one stays linear */
+    capacity = MAX(size, splash_capacity + splash_capacity / 2);
+    buffer = (unsigned char *)realloc(splBuffer, capacity);
+    if (buffer == NULL)
+        return ERROR_NO_MEM_FOR_MALLOC;
 
-    memcpy(&bfType, pImageBuffer, sizeof(bfType));
-    memcpy(&bfSize, pImageBuffer + sizeof(bfType), sizeof(bfSize));
-    memcpy(&bfOffBits, pImageBuffer + 3*sizeof(bfType) + sizeof(bfSize), sizeof(bfOffBits));
-    memcpy(&headerInfo, pImageBuffer + BMP_FILE_HEADER_SIZE, sizeof(headerInfo));
+    splBuffer = buffer;
+    splash_capacity = capacity;
+    return 0;
+}
 
-    if (bfType != 0x4D42)
-        return ERROR_NOT_BMP_FILE;
-    if(headerInfo.biBitCount != 24)// && headerInfo.biBitCount != 32)
-    {
-        return ERROR_NOT_24bit_BMP_FILE;
-    }
+int SplashBuilder::PlaceSplash(uint32 index, uint32 blobSize, uint32 *pBlobIndex)
+{
+    uint32 FlashEnd = 0, currChipSelect;
+    int nextChipSelect;
 
-    bitmapImage = (unsigned char *)malloc(bfSize - bfOffBits);
-    if (!bitmapImage)
-        return ERROR_NO_MEM_FOR_MALLOC;
+    if(ChipSelectSize[0] != 0)
+        FlashEnd = FLASH_THREE_ADDRESS + ChipSelectSize[0];
+    else if(ChipSelectSize[2] != 0)
+        FlashEnd = FLASH_TWO_ADDRESS   + ChipSelectSize[2];
+    else if(ChipSelectSize[1] != 0)
+        FlashEnd = FLASH_BASE_ADDRESS  + ChipSelectSize[1];
+
+    ChipSelectEnd[0] = FLASH_THREE_ADDRESS + ChipSelectSize[0];
+    ChipSelectEnd[1] = FLASH_BASE_ADDRESS  + ChipSelectSize[1];
+    ChipSelectEnd[2] = FLASH_TWO_ADDRESS   + ChipSelectSize[2];
 
-    memcpy(bitmapImage, pImageBuffer + bfOffBits, bfSize - bfOffBits);
+    if((index + splash_data_start_flash_address + blobSize) >= FlashEnd)
+        return ERROR_NO_SPACE_IN_FRMW;
 
-    bytesPerPixel = headerInfo.biBitCount / 8;
+    nextChipSelect = -1;
+    if((index + splash_data_start_flash_address) < ChipSelectEnd[1] &&
+            (index + splash_data_start_flash_address + blobSize) > ChipSelectEnd[1] &&
+            (ChipSelectSize[1] != 0x01000000))
+    {
+        currChipSelect = 1;
 
-    lineLength    =  headerInfo.biWidth * bytesPerPixel;
+        if(ChipSelectSize[2] != 0)
+            nextChipSelect = 2;
+        else if(ChipSelectSize[0] != 0)
+            nextChipSelect = 0;
+    }
 
-    if(lineLength % 4 != 0)
+    if((index + splash_data_start_flash_address) < ChipSelectEnd[2] &&
+            (index + splash_data_start_flash_address + blobSize) > ChipSelectEnd[2])
     {
-        lineLength = (lineLength / 4 + 1) * 4;
+        currChipSelect = 2;
+        nextChipSelect = 0;
     }
-    line1Data = (unsigned char *)malloc(lineLength);
 
-    if(line1Data == NULL)
+    /* a splash does not straddle chip selects, it moves to the start of the next one */
+    if(nextChipSelect != -1)
     {
-        free(bitmapImage);
-        return ERROR_NO_MEM_FOR_MALLOC;
+        //printf("OVERFLOW FLASH_CS%d, MOVING SPLASH DATA TO FLASH_CS%d \n", currChipSelect, nextChipSelect);
+        index = ChipSelectBase[nextChipSelect] - splash_data_start_flash_address;
     }
 
-    line2Data = (unsigned char *)malloc(lineLength);
+    *pBlobIndex = index;
+    return 0;
+}
+
+void SplashBuilder::WriteBlobInfo(int splashIndex, uint32 blobIndex, uint32 blobSize)
+{
+    SPLASH_BLOB_INFO *blob_info;
+
+    blob_info = (SPLASH_BLOB_INFO *)(splBuffer + sizeof(SPLASH_SUPER_BINARY_INFO) + (splashIndex * sizeof(SPLASH_BLOB_INFO)));
+    blob_info->BlobOffset = blobIndex + splash_data_start_flash_address;
+    blob_info->BlobSize   = blobSize;
 
-    if(line2Data == NULL)
+    /* check if it is crossing the 3rd chipselect, if yes remap it to 0th chip select */
+    if(blob_info->BlobOffset >= FLASH_THREE_ADDRESS)
     {
-        free(line1Data);
-        free(bitmapImage);
-        return ERROR_NO_MEM_FOR_MALLOC;
+        blob_info->BlobOffset -= 0x03000000;
     }
+}
 
-    // vertically flip the bitmap image
-    for(i = 0; i < (headerInfo.biHeight / 2); i++)
-    {
-        memcpy(line1Data, bitmapImage + (lineLength * i), lineLength);
-        memcpy(line2Data, bitmapImage + (lineLength * (headerInfo.biHeight - i - 1)), lineLength);
+void SplashBuilder::WriteSplash(int splashIndex, uint32 start, uint32 blobIndex, const SPLASH_ENCODED *pEncoded)
+{
+    WriteBlobInfo(splashIndex, blobIndex, sizeof(SPLASH_HEADER) + pEncoded->size);
 
-        unsigned char tempbyte;
+    memset(splBuffer + start, 0xFF, blobIndex - start);
+    memcpy(splBuffer + blobIndex, &pEncoded->header, sizeof(SPLASH_HEADER));
+    memcpy(splBuffer + blobIndex + sizeof(SPLASH_HEADER), pEncoded->pData, pEncoded->size);
+}
 
-        for(j = 0; j < headerInfo.biWidth; j++)
-        {
-            
-            tempbyte = line1Data[j * 3 + 2];
-            line1Data[j * 3 + 2] = line1Data[j * 3 + 1];
-            line1Data[j * 3 + 1] = tempbyte;
-
-            tempbyte = line2Data[j * 3 + 2];
-            line2Data[j * 3 + 2] = line2Data[j * 3 + 1];
-            line2Data[j * 3 + 1] = tempbyte;
-        }
+static bool SPLASH_BlobHolds(const unsigned char *pBlob, uint32 blobSize, const unsigned char *pImage,
+                             int width, int height, uint8 requested)
+/**
+ * Tells whether a stored splash is the one pImage would encode to, without encoding pImage.
+ * Uncompressed and 4 line data is the start of the image buffer as it is, RLE data is expanded
+ * and compared with the pixels. Under auto compression a 4 line blob also needs pImage to
+ * repeat within 4 lines, as the encoder would otherwise have picked another format.
+ */
+{
+    SPLASH_HEADER header;
+    const unsigned char *pData = pBlob + sizeof(SPLASH_HEADER);
+    unsigned char *decoded;
+    uint32 dataSize = blobSize - sizeof(SPLASH_HEADER);
+    uint32 imageSize = width * height * 3, decodedSize;
+    int lineLength = (width * 3 + 3) & ~3, period;
+    bool same;
+
+    memcpy(&header, pBlob, sizeof(header));
+
+    if (header.Compression != SPLASH_RLE_COMPRESSION)
+    {
+        if (dataSize > (uint32)(lineLength * height) || memcmp(pData, pImage, dataSize) != 0)
+            return false;
+        if (header.Compression != SPLASH_4LINE_COMPRESSION || requested == SPLASH_4LINE_COMPRESSION)
+            return true;
 
-        memcpy(bitmapImage + (lineLength * (headerInfo.biHeight - i - 1)), line1Data, lineLength);
-        memcpy(bitmapImage + (lineLength * i), line2Data, lineLength);
+        period = SPLASH_FindLinePeriod(pImage, width, height, lineLength);
+        return period != 0 && period <= 4;
     }
 
-    free(line1Data);
-    free(line2Data);
+    decoded = (unsigned char *)malloc(imageSize);
+    if (decoded == NULL)
+        return false;
 
-    unsigned char *rleBuffer = (unsigned char *)malloc((((headerInfo.biHeight * headerInfo.biWidth * bytesPerPixel) +
-                                                         ((headerInfo.biHeight * headerInfo.biWidth * 4) / 255) + (headerInfo.biWidth * 2) + 15) - 1));
+    decodedSize = imageSize;
+    same = SPLASH_PerformRLEUnCompression(pData, dataSize, decoded, &decodedSize) == 0 &&
+           decodedSize == imageSize && memcmp(decoded, pImage, imageSize) == 0;
 
-    if (rleBuffer == NULL)
+    free(decoded);
+    return same;
+}
+
+/* A hash match only counts when the stored blob is the one pImage would add */
+int SplashBuilder::FindStored(const SPLASH_STORED *pKey, const unsigned char *pImage) const
+{
+    int i;
+
+    for (i = 0; i < numStored; i++)
     {
-        free(bitmapImage);
-        return ERROR_NO_MEM_FOR_MALLOC;
+        if (SPLASH_SameContent(&stored[i], pKey) &&
+            SPLASH_BlobHolds(splBuffer + stored[i].blobIndex, stored[i].blobSize, pImage,
+                             pKey->width, pKey->height, pKey->requested))
+            return i;
     }
 
-    switch(*compression)
-    {
-    case 0: // force uncompress
-        splashSize  = headerInfo.biHeight * lineLength;
-        splashImage = bitmapImage;
-        break;
+    return -1;
+}
 
-    case 1: // force rle compress
-        SPLASH_PerformRLECompression(bitmapImage, rleBuffer, headerInfo.biWidth, headerInfo.biHeight, &splashSize);
-        splashImage = rleBuffer;
-        break;
+void SplashBuilder::AddStored(const SPLASH_STORED *pKey, uint8 compression, uint32 blobIndex, uint32 blobSize)
+{
+    /* past MAX_SPLASH_IMAGES distinct images duplicates are simply stored again */
+    if (numStored == MAX_SPLASH_IMAGES)
+        return;
+
+    stored[numStored] = *pKey;
+    stored[numStored].compression = compression;
+    stored[numStored].blobIndex = blobIndex;
+    stored[numStored].blobSize = blobSize;
+    numStored++;
+}
 
-    case 4: // force 4 line compress
-        splashSize  = 4 * lineLength;
-        splashImage = bitmapImage;
-        break;
+int SplashBuilder::AddSplash(unsigned char *pImageBuffer, uint8 *compression, uint32 *compSize)
+{
+    SPLASH_STORED key;
+    unsigned char *bitmapImage;
+    int width, height, ret;
 
-    default: // auto compression
+    if((!splBuffer || !splash_data_start_flash_address))
+        return ERROR_INIT_NOT_DONE_PROPERLY;
 
-        SPLASH_PerformLineCompression(bitmapImage, headerInfo.biWidth, headerInfo.biHeight, &lineCompSize, 4);
-        SPLASH_PerformRLECompression(bitmapImage, rleBuffer, headerInfo.biWidth, headerInfo.biHeight, &rleCompSize);
+    ret = SPLASH_LoadImage(pImageBuffer, *compression, &bitmapImage, &width, &height, &key);
+    if (ret < 0)
+        return ret;
 
-        splashSize  = headerInfo.biHeight * lineLength;
+    return AddImage(bitmapImage, bitmapImage, width, height, &key, compression, compSize);
+}
 
-        if(lineCompSize < splashSize)
-        {
-            splashSize  = 4 * lineLength;
-            splashImage = bitmapImage;
-            *compression = 4;
-        }
-        else if(rleCompSize < splashSize)
-        {
-            splashSize  = rleCompSize;
-            splashImage = rleBuffer;
-            *compression    = 1;
-        }
-        else
-        {
-            splashSize  = headerInfo.biHeight * lineLength;
-            splashImage = bitmapImage;
-            *compression    = 0;
-        }
+int SplashBuilder::AddSplashPixels(const unsigned char *pPixels, int width, int height, uint8 *compression, uint32 *compSize)
+{
+    SPLASH_STORED key;
 
-        break;
-    }
+    if((!splBuffer || !splash_data_start_flash_address))
+        return ERROR_INIT_NOT_DONE_PROPERLY;
+    if (pPixels == NULL || width <= 0 || height <= 0 || width > 0xFFFF || height > 0xFFFF)
+        return ERROR_WRONG_PARAMS;
 
-    splash_header.Signature		= 0x636C7053;
-    splash_header.Image_width	= (uint16)headerInfo.biWidth;
-    splash_header.Image_height	= (uint16)headerInfo.biHeight;
-    splash_header.Pixel_format	= 1; // 24-bit packed
-    splash_header.Subimg_offset = -1;
-    splash_header.Subimg_end	= -1;
-    splash_header.Bg_color		= 0;
-    splash_header.ByteOrder		= 1;
-    splash_header.ChromaOrder	= 0;
-    splash_header.Byte_count	= splashSize;
-    splash_header.Compression	= *compression;
+    SPLASH_MakeKey(pPixels, width, height, *compression, &key);
+    return AddImage(pPixels, NULL, width, height, &key, compression, compSize);
+}
 
-    blob_info = (SPLASH_BLOB_INFO *)(splBuffer + sizeof(SPLASH_SUPER_BINARY_INFO) + (splash_count * sizeof(SPLASH_BLOB_INFO)));
+/* Places an image after the previous splash, or points it at an identical blob; ownedImage is released */
+int SplashBuilder::AddImage(const unsigned char *pImage, unsigned char *ownedImage, int width, int height,
+                            const SPLASH_STORED *pKey, uint8 *compression, uint32 *compSize)
+{
+    SPLASH_ENCODED encoded;
+    uint32 blobIndex;
+    int found, ret;
 
-    uint32 FlashEnd, currChipSelect;
-    int nextChipSelect;
+    found = FindStored(pKey, pImage);
+    if (found >= 0)
+    {
+        free(ownedImage);
+        WriteBlobInfo(splash_count, stored[found].blobIndex, stored[found].blobSize);
+        splash_count++;
+        *compression = stored[found].compression;
+        *compSize = stored[found].blobSize - sizeof(SPLASH_HEADER);
+        return 0;
+    }
 
-    if(ChipSelectSize[0] != 0)
-        FlashEnd = FLASH_THREE_ADDRESS + ChipSelectSize[0];
-    else if(ChipSelectSize[2] != 0)
-        FlashEnd = FLASH_TWO_ADDRESS   + ChipSelectSize[2];
-    else if(ChipSelectSize[1] != 0)
-        FlashEnd = FLASH_BASE_ADDRESS  + ChipSelectSize[1];
+    ret = SPLASH_EncodeSplash(pImage, ownedImage, width, height, compression, &encoded);
+    if (ret < 0)
+        return ret;
 
-    ChipSelectEnd[0] = FLASH_THREE_ADDRESS + ChipSelectSize[0];
-    ChipSelectEnd[1] = FLASH_BASE_ADDRESS  + ChipSelectSize[1];
-    ChipSelectEnd[2] = FLASH_TWO_ADDRESS   + ChipSelectSize[2];
+    ret = PlaceSplash(splash_index, sizeof(SPLASH_HEADER) + encoded.size, &blobIndex);
+    if (ret < 0)
+    {
+        // printf("NO SPACE LEFT IN THE FLASH CAN'T WRITE SPLASH [%d]\n", splash_count);
+        splash_count++;
+    }
+    else
+        ret = Reserve(blobIndex + sizeof(SPLASH_HEADER) + encoded.size);
 
-    if((splash_index + splash_data_start_flash_address + sizeof(splash_header) + splashSize) < FlashEnd)
+    if (ret == 0)
     {
-        nextChipSelect = -1;
-        if((splash_index + splash_data_start_flash_address) < ChipSelectEnd[1] &&
-                (splash_index + splash_data_start_flash_address + sizeof(splash_header) + splashSize) > ChipSelectEnd[1] &&
-                (ChipSelectSize[1] != 0x01000000))
-        {
-            currChipSelect = 1;
+        WriteSplash(splash_count, splash_index, blobIndex, &encoded);
+        AddStored(pKey, *compression, blobIndex, sizeof(SPLASH_HEADER) + encoded.size);
+        splash_index = blobIndex + sizeof(SPLASH_HEADER) + encoded.size;
+        splash_count++;
+        *compSize = encoded.size;
+    }
 
-            if(ChipSelectSize[2] != 0)
-                nextChipSelect = 2;
-            else if(ChipSelectSize[0] != 0)
-                nextChipSelect = 0;
-        }
+    SPLASH_FreeEncoded(&encoded);
+    return ret;
+}
+
+int SplashBuilder::AddSplashes(unsigned char **ppImageBuffers, int numImages, uint8 *compression, uint32 *compSize, int numThreads)
+{
+    std::vector<unsigned char *> images;
+    std::vector<int> width, height, sameAs, storedAs, fits;
+    std::vector<SPLASH_STORED> keys;
+    std::vector<SPLASH_ENCODED> encoded;
+    std::vector<uint32> start, blobIndex;
+    std::atomic<int> result(0);
+    uint32 end;
+    int i, j, ret;
+
+    if((!splBuffer || !splash_data_start_flash_address))
+        return ERROR_INIT_NOT_DONE_PROPERLY;
+    if (ppImageBuffers == NULL || numImages < 0 || compression == NULL || compSize == NULL)
+        return ERROR_WRONG_PARAMS;
 
-        if((splash_index + splash_data_start_flash_address) < ChipSelectEnd[2] &&
-                (splash_index + splash_data_start_flash_address + sizeof(splash_header) + splashSize) > ChipSelectEnd[2])
+    images.assign(numImages, NULL);
+    width.resize(numImages);
+    height.resize(numImages);
+    sameAs.resize(numImages);
+    storedAs.assign(numImages, -1);
+    fits.assign(numImages, 0);
+    keys.resize(numImages);
+    encoded.resize(numImages);
+    start.resize(numImages);
+    blobIndex.resize(numImages);
+
+    /* load and hash all images concurrently */
+    SPLASH_ParallelFor(numImages, numThreads, [&](int index)
+    {
+        int expected = 0;
+        int err = SPLASH_LoadImage(ppImageBuffers[index], compression[index], &images[index], &width[index], &height[index], &keys[index]);
+        if (err < 0)
+            result.compare_exchange_strong(expected, err);
+    });
+    ret = result;
+
+    /* an image already stored, or seen earlier in this batch, is not compressed again */
+    for (i = 0; ret == 0 && i < numImages; i++)
+    {
+        storedAs[i] = FindStored(&keys[i], images[i]);
+        for (sameAs[i] = i, j = 0; storedAs[i] < 0 && j < i; j++)
         {
-            currChipSelect = 2;
-            nextChipSelect = 0;
+            if (sameAs[j] == j && storedAs[j] < 0 && SPLASH_SameContent(&keys[j], &keys[i]) &&
+                memcmp(images[j], images[i], ((width[i] * 3 + 3) & ~3) * height[i]) == 0)
+            {
+                sameAs[i] = j;
+                break;
+            }
         }
+    }
 
-        if(nextChipSelect != -1)
+    /* compress the new images concurrently */
+    if (ret == 0)
+    {
+        SPLASH_ParallelFor(numImages, numThreads, [&](int index)
         {
-            //printf("OVERFLOW FLASH_CS%d, MOVING SPLASH [%d] DATA TO FLASH_CS%d \n", currChipSelect, splash_count, nextChipSelect);
-            //printf("BYTES UNUSED IN FLASH_CS%d = 0x%08X <%d> bytes\n", currChipSelect, ChipSelectEnd[currChipSelect] -
-            //       splash_data_start_flash_address - splash_index, ChipSelectEnd[currChipSelect] - splash_data_start_flash_address - splash_index);
-
-            splBuffer = (unsigned char *)realloc(splBuffer, ChipSelectBase[nextChipSelect] - splash_data_start_flash_address);
-
-            memset(splBuffer + splash_index, 0xFF, ChipSelectBase[nextChipSelect] - splash_data_start_flash_address - splash_index);
-
-            splash_index = ChipSelectBase[nextChipSelect] - splash_data_start_flash_address;
+            int expected = 0;
+            int err;
+
+            if (sameAs[index] != index || storedAs[index] >= 0)
+                return;
+
+            err = SPLASH_EncodeSplash(images[index], images[index], width[index], height[index], &compression[index], &encoded[index]);
+            images[index] = NULL;   // owned by encoded now, or released on error
+            if (err < 0)
+                result.compare_exchange_strong(expected, err);
+        });
+        ret = result;
+    }
 
-            blob_info = (SPLASH_BLOB_INFO *)(splBuffer + sizeof(SPLASH_SUPER_BINARY_INFO) + (splash_count * sizeof(SPLASH_BLOB_INFO)));
-        }
-        blob_info->BlobOffset = splash_index + splash_data_start_flash_address;
-        blob_info->BlobSize   = sizeof(splash_header) + splashSize;
+    for (i = 0; i < numImages; i++)
+        free(images[i]);
 
-        /* check if it is crossing the 3rd chipselect, if yes remap it to 0th chip select */
-        if(blob_info->BlobOffset >= FLASH_THREE_ADDRESS)
+    /* lay out in input order, giving the same offsets as adding them one by one: an image that
+     * does not fit is left out and the following ones are still placed, duplicates taking no space */
+    end = splash_index;
+    for (i = 0; ret == 0 && i < numImages; i++)
+    {
+        if (storedAs[i] >= 0)
+            fits[i] = 1;
+        else if (sameAs[i] != i)
+            fits[i] = fits[sameAs[i]];
+        else if (PlaceSplash(end, sizeof(SPLASH_HEADER) + encoded[i].size, &blobIndex[i]) == 0)
         {
-            blob_info->BlobOffset -= 0x03000000;
+            start[i] = end;
+            end = blobIndex[i] + sizeof(SPLASH_HEADER) + encoded[i].size;
+            fits[i] = 1;
         }
+    }
 
-        splBuffer = (unsigned char *)realloc(splBuffer, splash_index + sizeof(splash_header) + splashSize);
-
-        memcpy(splBuffer + splash_index, &splash_header, sizeof(splash_header));
+    /* one allocation for the whole blob, then the images are copied in parallel */
+    if (ret == 0)
+        ret = Reserve(end);
 
-        splash_index += sizeof(splash_header);
+    if (ret == 0)
+    {
+        SPLASH_ParallelFor(numImages, numThreads, [&](int index)
+        {
+            int source = sameAs[index];
+
+            if (!fits[index])
+                return;
+            if (storedAs[index] >= 0)
+                WriteBlobInfo(splash_count + index, stored[storedAs[index]].blobIndex, stored[storedAs[index]].blobSize);
+            else if (source != index)
+                WriteBlobInfo(splash_count + index, blobIndex[source], sizeof(SPLASH_HEADER) + encoded[source].size);
+            else
+                WriteSplash(splash_count + index, start[index], blobIndex[index], &encoded[index]);
+        });
 
-        memcpy(splBuffer + splash_index, splashImage, splashSize);
+        for (i = 0; i < numImages; i++)
+        {
+            if (storedAs[i] >= 0)
+            {
+                compression[i] = stored[storedAs[i]].compression;
+                compSize[i] = stored[storedAs[i]].blobSize - sizeof(SPLASH_HEADER);
+            }
+            else
+            {
+                compression[i] = compression[sameAs[i]];
+                if (fits[i])
+                    compSize[i] = encoded[sameAs[i]].size;
+                else
+                {
+                    // printf("NO SPACE LEFT IN THE FLASH CAN'T WRITE SPLASH [%d]\n", splash_count + i);
+                    ret = ERROR_NO_SPACE_IN_FRMW;
+                }
+            }
+        }
 
-        splash_index += splashSize;
+        for (i = 0; i < numImages; i++)
+        {
+            if (fits[i] && sameAs[i] == i && storedAs[i] < 0)
+                AddStored(&keys[i], compression[i], blobIndex[i], sizeof(SPLASH_HEADER) + encoded[i].size);
+        }
 
-        splash_count++;
-    }
-    else
-    {
-        splash_count++;
-        // printf("NO SPACE LEFT IN THE FLASH CAN'T WRITE SPLASH [%d]\n", splash_count);
-        return ERROR_NO_SPACE_IN_FRMW;
+        splash_index = end;
+        splash_count += numImages;  // images that did not fit are counted, as AddSplash counts them
     }
 
-    free(rleBuffer);
-    free(bitmapImage);
-    *compSize = splashSize;
-    return 0;
+    for (i = 0; i < numImages; i++)
+        SPLASH_FreeEncoded(&encoded[i]);
+
+    return ret;
 }
 
-void DLPC350_Frmw_Get_NewFlashImage(unsigned char **newFrmwbuffer, uint32 *newFrmwsize)
+void FirmwareImage::Get_NewFlashImage(unsigned char **newFrmwbuffer, uint32 *newFrmwsize)
 {
+    unsigned char *splBuffer;
+    uint32 splash_index;
+
+    splash.GetBuffer(&splBuffer, &splash_index);
+
     uint32 newfrmFileInLen = (splash_data_start_flash_address - FLASH_BASE_ADDRESS) + splash_index;
 
+    /* the splashes are replaced by the new splash buffer */
+    cache.Clear();
+
     pFrmwImageArray	= (unsigned char *)realloc(pFrmwImageArray, newfrmFileInLen);
     memcpy(pFrmwImageArray + (splash_data_start_flash_address - FLASH_BASE_ADDRESS), splBuffer, splash_index);
+    frmwImageSize = newfrmFileInLen;
 
     *newFrmwbuffer = pFrmwImageArray;
     *newFrmwsize = newfrmFileInLen;
 }
 
-void DLPC350_Frmw_Get_NewSplashBuffer(unsigned char **newSplashBuffer, uint32 *newSplashSize)
+void SplashBuilder::GetBuffer(unsigned char **newSplashBuffer, uint32 *newSplashSize) const
 {
     *newSplashBuffer = splBuffer;
     *newSplashSize = splash_index;
 }
 
-void DLPC350_Frmw_UpdateFlashTableSplashAddress(unsigned char *flashTableSectorBuffer, uint32 address_offset)
+void FirmwareImage::UpdateFlashTableSplashAddress(unsigned char *flashTableSectorBuffer, uint32 address_offset)
 {
     FLASH_TABLE *flash_table;
     unsigned char *temp_flashTableSector = (unsigned char*) malloc(128 * 1024);
 
     splash_data_start_flash_address = address_offset + FLASH_BASE_ADDRESS;
+    splash.SetSplashStartAddress(splash_data_start_flash_address);
     memcpy(temp_flashTableSector, pFrmwImageArray + FLASH_TABLE_ADDRESS, 128 * 1024);
     flash_table = (FLASH_TABLE *)(temp_flashTableSector);
 
@@ -1118,21 +2588,17 @@ void DLPC350_Frmw_UpdateFlashTableSplashAddress(unsigned char *flashTableSectorB
     free(temp_flashTableSector);
 }
 
-char firstIniToken[128];
-uint32 iniParams[MAX_VAR_EXP_PAT_LUT_ENTRIES*3];
-uint32 numIniParams;
-
-int DLPC350_Frmw_ParseIniLines(char *line)
+int FirmwareImage::ParseIniLines(char *line)
 {
     const char space[2] = " ";
-    char *token;
+    char *token, *context;
     unsigned int tmpIntVar;
     bool isParamNameRcvd = false;
 
     numIniParams = 0;
 
     /* get the first token */
-    token = strtok(&line[0], &space[0]);
+    token = STRTOK_R(&line[0], &space[0], &context);
 
     /* walk through other tokens */
     while( token != NULL )
@@ -1180,7 +2646,7 @@ int DLPC350_Frmw_ParseIniLines(char *line)
             }
         }
 
-        token = strtok(NULL, space);
+        token = STRTOK_R(NULL, space, &context);
     }
 
     //If there is no valid token in the line
@@ -1199,7 +2665,7 @@ int DLPC350_Frmw_ParseIniLines(char *line)
 }
 
 //Below function is called after DLPC350_Frmw_ParseIniLines() function
-void DLPC350_Frmw_GetCurrentIniLineParam(char *token, uint32 *params, int *numParams)
+void FirmwareImage::GetCurrentIniLineParam(char *token, uint32 *params, int *numParams) const
 {
     unsigned int i = 0;
 
@@ -1214,3 +2680,119 @@ void DLPC350_Frmw_GetCurrentIniLineParam(char *token, uint32 *params, int *numPa
     return;
 }
 
+/*
+ * Process-wide image behind the DLPC350_Frmw_* functions. Use FirmwareImage directly to work on
+ * several images at once.
+ */
+static FirmwareImage g_FirmwareImage;
+
+int DLPC350_Frmw_CopyAndVerifyImage(const unsigned char *pByteArray, int size)
+{
+    return g_FirmwareImage.CopyAndVerifyImage(pByteArray, size);
+}
+
+int DLPC350_Frmw_GetSplashCount()
+{
+    return g_FirmwareImage.GetSplashCount();
+}
+
+unsigned int DLPC350_Frmw_GetVersionNumber()
+{
+    return g_FirmwareImage.GetVersionNumber();
+}
+
+unsigned int DLPC350_Frmw_GetSPlashFlashStartAddress()
+{
+    return g_FirmwareImage.GetSplashFlashStartAddress();
+}
+
+int DLPC350_Frmw_GetSpashImage(unsigned char *pImageBuffer, int index)
+{
+    return g_FirmwareImage.GetSplashImage(pImageBuffer, index);
+}
+
+int DLPC350_Frmw_GetSplashImageHandle(int index, SPLASH_IMAGE *pImage)
+{
+    return g_FirmwareImage.GetSplashImageHandle(index, pImage);
+}
+
+void DLPC350_Frmw_SetSplashCacheSize(uint32 maxBytes)
+{
+    g_FirmwareImage.SetSplashCacheSize(maxBytes);
+}
+
+int DLPC350_Frmw_GetSplashImageSize(int index, uint16 *pWidth, uint16 *pHeight)
+{
+    return g_FirmwareImage.GetSplashImageSize(index, pWidth, pHeight);
+}
+
+int DLPC350_Frmw_GetSplashImages(unsigned char **ppImageBuffers, int numImages, int numThreads)
+{
+    return g_FirmwareImage.GetSplashImages(ppImageBuffers, numImages, numThreads);
+}
+
+int DLPC350_Frmw_SPLASH_InitBuffer(int numSplash)
+{
+    return g_FirmwareImage.SPLASH_InitBuffer(numSplash);
+}
+
+int DLPC350_Frmw_SPLASH_AddSplash(unsigned char *pImageBuffer, uint8 *compression, uint32 *compSize)
+{
+    return g_FirmwareImage.SPLASH_AddSplash(pImageBuffer, compression, compSize);
+}
+
+int DLPC350_Frmw_SPLASH_AddSplashPixels(const unsigned char *pPixels, int width, int height, uint8 *compression, uint32 *compSize)
+{
+    return g_FirmwareImage.SPLASH_AddSplashPixels(pPixels, width, height, compression, compSize);
+}
+
+int DLPC350_Frmw_SPLASH_AddSplashes(unsigned char **ppImageBuffers, int numImages, uint8 *compression, uint32 *compSize, int numThreads)
+{
+    return g_FirmwareImage.SPLASH_AddSplashes(ppImageBuffers, numImages, compression, compSize, numThreads);
+}
+
+void DLPC350_Frmw_Get_NewFlashImage(unsigned char **newFrmwbuffer, uint32 *newFrmwsize)
+{
+    g_FirmwareImage.Get_NewFlashImage(newFrmwbuffer, newFrmwsize);
+}
+
+void DLPC350_Frmw_Get_NewSplashBuffer(unsigned char **newSplashBuffer, uint32 *newSplashSize)
+{
+    g_FirmwareImage.Get_NewSplashBuffer(newSplashBuffer, newSplashSize);
+}
+
+void DLPC350_Frmw_UpdateFlashTableSplashAddress(unsigned char *flashTableSectorBuffer, uint32 address_offset)
+{
+    g_FirmwareImage.UpdateFlashTableSplashAddress(flashTableSectorBuffer, address_offset);
+}
+
+int DLPC350_Frmw_ParseIniLines(char *iniLine)
+{
+    return g_FirmwareImage.ParseIniLines(iniLine);
+}
+
+void DLPC350_Frmw_GetCurrentIniLineParam(char *token, uint32 *params, int *numParams)
+{
+    g_FirmwareImage.GetCurrentIniLineParam(token, params, numParams);
+}
+
+/**
+ * GUI defined parameter storage of a token: inline for the scalar tokens, in the shared
+ * arena for DEFAULT.SPLASHLUT and DEFAULT.SEQPATLUT. *pMaxParams gets its size.
+ */
+uint32 *DLPC350_Frmw_GetIniGuiParams(INIPARAM_INFO *pInfo, int *pMaxParams)
+{
+    if (pInfo->lut_param != NULL)
+    {
+        *pMaxParams = pInfo->max_params;
+        return pInfo->lut_param;
+    }
+
+    *pMaxParams = INIPARAM_INLINE_PARAMS;
+    return pInfo->gui_defined_param;
+}
+
+int DLPC350_Frmw_WriteApplConfigData(char *token, uint32 *params, int numParams)
+{
+    return g_FirmwareImage.WriteApplConfigData(token, params, numParams);
+}
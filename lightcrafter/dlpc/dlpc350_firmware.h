@@ -43,11 +43,19 @@
 
 #include "dlpc350_common.h"
 
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
 #define RELEASE_FW_VERSION  0x030000        // update for new DLPC350 binaries
 
 #define MAX_FIRMWARE_BYTES                  31457280 // Only 30MB for safety even though LCr4500 has 32MB onboard
 #define MAX_SPLASH_IMAGES                   256
 #define FLASH_TABLE_SPLASH_INDEX            0
+#define SPLASH_CACHE_DEFAULT_BYTES          (64 * 1024 * 1024) // decoded splashes kept by GetSplashImage
 #define FLASHTABLE_APP_SIGNATURE            0x01234567
 
 #define FLASH_NUM_APP_ADDRS                 4
@@ -71,12 +79,33 @@
 #define ERROR_INIT_NOT_DONE_PROPERLY            -6
 #define ERROR_WRONG_PARAMS                      -7
 #define ERROR_NO_SPACE_IN_FRMW                  -8
+#define ERROR_CANNOT_OPEN_FILE                  -9
+#define ERROR_OUT_OF_BOUNDS                     -10
+#define ERROR_RLE_MISMATCH                      -11
 
 #define SPLASH_UNCOMPRESSED                     0
 #define SPLASH_RLE_COMPRESSION                  1
 #define SPLASH_4LINE_COMPRESSION                4
 #define SPLASH_NOCOMP_SPECIFIED                 5
 
+/* Structured light pattern families rendered by DLPC350_Frmw_RenderPatterns */
+#define PATTERN_BINARY                          0
+#define PATTERN_GRAY_CODE                       1
+#define PATTERN_PHASE_SHIFT                     2
+
+/*
+ * Binary and Gray code pattern k (0 = most significant bit, the widest stripes) is bit k % 24
+ * of image k / 24, in G0..B7 order. Phase shift step k is the 8 bit channel k % 3 (G, R, B) of
+ * image k / 3, with intensity 127.5 + 127.5 * cos(2 pi x / period + 2 pi k / numPatterns).
+ */
+typedef struct
+{
+    int family;         /* PATTERN_BINARY, PATTERN_GRAY_CODE or PATTERN_PHASE_SHIFT */
+    int horizontal;     /* 0 = vertical stripes coding the column, 1 = horizontal stripes coding the row */
+    int numPatterns;    /* bit planes (0 = enough for every column or row; fewer keep the widest) or phase steps */
+    int period;         /* PATTERN_PHASE_SHIFT: pixels per sinusoid period */
+} PATTERN_SET;
+
 typedef struct
 {
     uint32 Address;    /* Address of block */
@@ -148,16 +177,23 @@ typedef struct splashhdr
     uint8   Pad[4];         /**< pad so that data starts at 16-byte boundary */
 } SPLASH_HEADER;
 
+/* Parameters held in INIPARAM_INFO itself; the LUT tokens keep their GUI values in a shared arena */
+#define INIPARAM_INLINE_PARAMS              3
+#define INIPARAM_SPLASHLUT_PARAMS           MAX_VAR_EXP_IMAGE_LUT_ENTRIES
+#define INIPARAM_SEQPATLUT_PARAMS           (MAX_VAR_EXP_PAT_LUT_ENTRIES*3)
+
 typedef struct iniParamInfo
 {
-    char token[128];
-    uint32 default_param[1824*3];
-    uint32 gui_defined_param[1824*3];
+    const char *token;
+    uint32 default_param[INIPARAM_INLINE_PARAMS];
+    uint32 gui_defined_param[INIPARAM_INLINE_PARAMS];   /* use DLPC350_Frmw_GetIniGuiParams */
     int nr_default_params;
     int nr_user_defined_params;
     bool is_gui_editable;
     int frmw_offset;
     int frmw_size;
+    uint32 *lut_param;      /* arena storage of the LUT tokens, NULL for the others */
+    int max_params;         /* size of lut_param */
 } INIPARAM_INFO;
 
 enum iniTokens
@@ -229,17 +265,215 @@ enum iniTokens
 
 #define NR_INI_GUI_TOKENS  42 //Is taken from iniGUITokens list entries
 
+extern INIPARAM_INFO g_iniParam_Info[NR_INI_TOKENS];
+
+/* A decoded splash: width * height B, G, R pixels, as GetSplashImage writes them */
+typedef struct
+{
+    uint16 width;
+    uint16 height;
+    std::vector<unsigned char> pixels;
+} SPLASH_DECODED;
+
+/* Read-only handle to a decoded splash, still valid after the cache has dropped it */
+typedef std::shared_ptr<const SPLASH_DECODED> SPLASH_IMAGE;
+
+int DLPC350_Frmw_LocateFlashTable(const unsigned char *pByteArray, uint32 size, uint32 *pTableAddress);
 int DLPC350_Frmw_CopyAndVerifyImage(const unsigned char *pByteArray, int size);
 int DLPC350_Frmw_GetSplashCount();
 unsigned int  DLPC350_Frmw_GetVersionNumber();
 unsigned int DLPC350_Frmw_GetSPlashFlashStartAddress();
 int DLPC350_Frmw_GetSpashImage(unsigned char *pImageBuffer, int index);
+int DLPC350_Frmw_GetSplashImageSize(int index, uint16 *pWidth, uint16 *pHeight);
+int DLPC350_Frmw_GetSplashImages(unsigned char **ppImageBuffers, int numImages, int numThreads);
+int DLPC350_Frmw_GetSplashImageHandle(int index, SPLASH_IMAGE *pImage);
+void DLPC350_Frmw_SetSplashCacheSize(uint32 maxBytes);
+void DLPC350_SwapGB(unsigned char *pPixels, uint32 numPixels);
+int DLPC350_Frmw_BenchmarkRLE(const unsigned char *pImage, int width, int height, int iterations, double *pReferenceMs, double *pVectorMs);
+int DLPC350_Frmw_GetPatternImageCount(const PATTERN_SET *pSet, int width, int height);
+int DLPC350_Frmw_RenderPatterns(const PATTERN_SET *pSet, int width, int height, unsigned char **ppImages, int numThreads);
 int DLPC350_Frmw_SPLASH_InitBuffer(int numSplash);
 int DLPC350_Frmw_SPLASH_AddSplash(unsigned char *pImageBuffer, uint8 *compression, uint32 *compSize);
+int DLPC350_Frmw_SPLASH_AddSplashPixels(const unsigned char *pPixels, int width, int height, uint8 *compression, uint32 *compSize);
+int DLPC350_Frmw_SPLASH_AddSplashes(unsigned char **ppImageBuffers, int numImages, uint8 *compression, uint32 *compSize, int numThreads);
 void DLPC350_Frmw_Get_NewFlashImage(unsigned char **newFrmwbuffer, uint32 *newFrmwsize);
 void DLPC350_Frmw_Get_NewSplashBuffer(unsigned char **newSplashBuffer, uint32 *newSplashSize);
 void DLPC350_Frmw_UpdateFlashTableSplashAddress(unsigned char *flashTableSectorBuffer, uint32 address_offset);
 int DLPC350_Frmw_ParseIniLines(char *iniLine);
 void DLPC350_Frmw_GetCurrentIniLineParam(char *token, uint32 *params, int *numParams);
 int DLPC350_Frmw_WriteApplConfigData(char *token, uint32 *params, int numParams);
+uint32 *DLPC350_Frmw_GetIniGuiParams(INIPARAM_INFO *pInfo, int *pMaxParams);
+
+/* A compressed splash ready to be placed in the splash blob */
+typedef struct
+{
+    SPLASH_HEADER header;
+    const unsigned char *pData;     /* points into pBitmap or pRle */
+    uint32 size;
+    unsigned char *pBitmap;
+    unsigned char *pRle;
+} SPLASH_ENCODED;
+
+/* A splash already in the blob, found again by the content of its pixels */
+typedef struct
+{
+    unsigned long long hash[2];
+    uint16 width;
+    uint16 height;
+    uint8 requested;        /* compression asked for, SPLASH_NOCOMP_SPECIFIED for auto */
+    uint8 compression;      /* compression used */
+    uint32 blobIndex;       /* header position in the splash buffer */
+    uint32 blobSize;
+} SPLASH_STORED;
+
+/**
+ * Builds the splash super binary (blob table followed by the splash images) for one firmware image.
+ * Every instance keeps its own buffer and chip select layout.
+ */
+class SplashBuilder
+{
+public:
+    SplashBuilder();
+    ~SplashBuilder();
+
+    int InitBuffer(uint32 splashStartAddress, int numSplash);
+
+    /* An image identical to one added before, with the same requested compression, is stored
+     * once; its blob info points at the stored blob. */
+    int AddSplash(unsigned char *pImageBuffer, uint8 *compression, uint32 *compSize);
+
+    /* Adds an image already in splash layout, as produced from a BMP by AddSplash: top row
+     * first, rows (width * 3 + 3) & ~3 bytes apart, bytes B, R, G. The pixels are not kept. */
+    int AddSplashPixels(const unsigned char *pPixels, int width, int height, uint8 *compression, uint32 *compSize);
+
+    /* Same result as AddSplash on each image in order, but the images are compressed on
+     * numThreads threads (0 = one per core) and written into a single allocation.
+     * compression and compSize hold one entry per image. */
+    int AddSplashes(unsigned char **ppImageBuffers, int numImages, uint8 *compression, uint32 *compSize, int numThreads = 0);
+    void GetBuffer(unsigned char **newSplashBuffer, uint32 *newSplashSize) const;
+
+    void SetSplashStartAddress(uint32 splashStartAddress) { splash_data_start_flash_address = splashStartAddress; }
+    void SetChipSelectSize(int chipSelect, uint32 size);
+
+private:
+    SplashBuilder(const SplashBuilder &);
+    SplashBuilder &operator=(const SplashBuilder &);
+
+    int Reserve(uint32 size);
+    int AddImage(const unsigned char *pImage, unsigned char *ownedImage, int width, int height,
+                 const SPLASH_STORED *pKey, uint8 *compression, uint32 *compSize);
+    int PlaceSplash(uint32 index, uint32 blobSize, uint32 *pBlobIndex);
+    void WriteBlobInfo(int splashIndex, uint32 blobIndex, uint32 blobSize);
+    void WriteSplash(int splashIndex, uint32 start, uint32 blobIndex, const SPLASH_ENCODED *pEncoded);
+    int FindStored(const SPLASH_STORED *pKey, const unsigned char *pImage) const;
+    void AddStored(const SPLASH_STORED *pKey, uint8 compression, uint32 blobIndex, uint32 blobSize);
+
+    unsigned char *splBuffer;
+    uint32 splash_index;
+    uint32 splash_capacity;
+    int splash_count;
+    uint32 splash_data_start_flash_address;
+    uint32 ChipSelectSize[3];
+    uint32 ChipSelectEnd[3];
+    uint32 ChipSelectBase[3];
+
+    /* splashes in the buffer by content, duplicates point at the same blob */
+    SPLASH_STORED stored[MAX_SPLASH_IMAGES];
+    int numStored;
+};
+
+/**
+ * Least recently used decoded splashes of one firmware image, up to a byte budget. Entries are
+ * keyed by the position of the splash in the image, so indices sharing a blob share an entry.
+ */
+class SplashCache
+{
+public:
+    SplashCache();
+
+    /* 0 turns caching off */
+    void SetLimit(size_t maxBytes);
+    SPLASH_IMAGE Find(uint32 key);
+    void Insert(uint32 key, const SPLASH_IMAGE &image);
+    void Clear();
+
+private:
+    SplashCache(const SplashCache &);
+    SplashCache &operator=(const SplashCache &);
+
+    void Trim();
+
+    typedef std::list<std::pair<uint32, SPLASH_IMAGE> > EntryList;
+
+    EntryList entries;      /* most recently used first */
+    std::unordered_map<uint32, EntryList::iterator> lookup;
+    size_t usedBytes;
+    size_t limitBytes;
+    std::mutex mutex;
+};
+
+/**
+ * A firmware image and the state of its splash and ini editing. The DLPC350_Frmw_* functions
+ * operate on one process-wide instance; separate instances can be used from separate threads.
+ */
+class FirmwareImage
+{
+public:
+    FirmwareImage();
+    ~FirmwareImage();
+
+    int CopyAndVerifyImage(const unsigned char *pByteArray, int size);
+    unsigned int GetVersionNumber() const;
+    int WriteApplConfigData(char *token, uint32 *params, int numParams);
+
+    int GetSplashCount() const;
+    unsigned int GetSplashFlashStartAddress() const;
+    int GetSplashImage(unsigned char *pImageBuffer, int index) const;
+    int GetSplashImageSize(int index, uint16 *pWidth, uint16 *pHeight) const;
+
+    /* Decoded splash from the cache, decoding and caching it on a miss. The cache is emptied
+     * when the image is replaced or its splash area rewritten. */
+    int GetSplashImageHandle(int index, SPLASH_IMAGE *pImage) const;
+    void SetSplashCacheSize(size_t maxBytes) { cache.SetLimit(maxBytes); }
+
+    /* Decodes splashes 0..numImages-1 on numThreads threads (0 = one per core) into
+     * ppImageBuffers[i], each width * height * 3 bytes. NULL entries are skipped. Returns
+     * the first error met, after all other images have been decoded. Bypasses the cache. */
+    int GetSplashImages(unsigned char **ppImageBuffers, int numImages, int numThreads = 0) const;
+
+    int SPLASH_InitBuffer(int numSplash);
+    int SPLASH_AddSplash(unsigned char *pImageBuffer, uint8 *compression, uint32 *compSize);
+    int SPLASH_AddSplashPixels(const unsigned char *pPixels, int width, int height, uint8 *compression, uint32 *compSize);
+    int SPLASH_AddSplashes(unsigned char **ppImageBuffers, int numImages, uint8 *compression, uint32 *compSize, int numThreads = 0);
+    void Get_NewFlashImage(unsigned char **newFrmwbuffer, uint32 *newFrmwsize);
+    void Get_NewSplashBuffer(unsigned char **newSplashBuffer, uint32 *newSplashSize) const;
+    void UpdateFlashTableSplashAddress(unsigned char *flashTableSectorBuffer, uint32 address_offset);
+
+    int ParseIniLines(char *iniLine);
+    void GetCurrentIniLineParam(char *token, uint32 *params, int *numParams) const;
+
+    const unsigned char *GetImage() const { return pFrmwImageArray; }
+    uint32 GetImageSize() const { return frmwImageSize; }
+    SplashBuilder &GetSplashBuilder() { return splash; }
+
+private:
+    FirmwareImage(const FirmwareImage &);
+    FirmwareImage &operator=(const FirmwareImage &);
+
+    int LocateSplash(int index, SPLASH_HEADER *pHeader, const unsigned char **ppData, uint32 *pSize) const;
+
+    unsigned char *pFrmwImageArray;
+    uint32 frmwImageSize;
+    uint32 FLASH_TABLE_ADDRESS;
+    uint32 splash_data_start_flash_address;
+    uint32 appl_config_data_flash_address;
+    int trigMode;
+
+    char firstIniToken[128];
+    uint32 iniParams[MAX_VAR_EXP_PAT_LUT_ENTRIES*3];
+    uint32 numIniParams;
+
+    SplashBuilder splash;
+    mutable SplashCache cache;
+};
 #endif
@@ -0,0 +1,316 @@
+﻿/*
+ * dlpc350_firmwareView.cpp
+ *
+ * This module gives read access to a firmware image file through a private memory mapping,
+ * without copying the image. Modified regions are copied on write by the OS, page by page.
+ *
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "dlpc350_common.h"
+#include "dlpc350_firmware.h"
+#include "dlpc350_firmwareView.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define FLASH_CS0_REMAP_OFFSET                  0x03000000  // 0xF8xxxxxx is chip select 0, mapped at 0xFBxxxxxx
+
+static int FrmwView_AddressToOffset(const DLPC350_FRMW_VIEW *pView, uint32 address, uint32 size, uint32 *pOffset)
+/**
+ * This function is private to this file. Converts a flash address to an offset in the image and checks that
+ * [offset, offset + size) lies inside the image.
+ *
+ * @return  0 = PASS
+ *          ERROR_OUT_OF_BOUNDS = FAIL
+ *
+ */
+{
+    uint32 offset;
+
+    if (address < FLASH_BASE_ADDRESS)
+        address += FLASH_CS0_REMAP_OFFSET;
+    if (address < FLASH_BASE_ADDRESS)
+        return ERROR_OUT_OF_BOUNDS;
+
+    offset = address - FLASH_BASE_ADDRESS;
+    if (offset > pView->size || size > pView->size - offset)
+        return ERROR_OUT_OF_BOUNDS;
+
+    *pOffset = offset;
+    return 0;
+}
+
+int DLPC350_FrmwView_Open(DLPC350_FRMW_VIEW *pView, const char *fileName)
+/**
+ * Maps a firmware image file copy-on-write and locates its flash table.
+ * Nothing is read from the file except the pages that are accessed.
+ *
+ * @param   pView - O - view to be initialized; release with DLPC350_FrmwView_Close()
+ * @param   fileName - I - firmware image file
+ *
+ * @return  0 = PASS
+ *          <0 = FAIL
+ *
+ */
+{
+    unsigned long long fileSize;
+    unsigned char *pBase;
+    uint32 splashAddress;
+    int ret;
+
+    memset(pView, 0, sizeof(*pView));
+
+#ifdef _WIN32
+    HANDLE hFile, hMapping;
+    LARGE_INTEGER size;
+
+    hFile = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return ERROR_CANNOT_OPEN_FILE;
+
+    if (!GetFileSizeEx(hFile, &size) || size.QuadPart == 0 || size.QuadPart > MAX_FIRMWARE_BYTES)
+    {
+        CloseHandle(hFile);
+        return ERROR_WRONG_PARAMS;
+    }
+    fileSize = size.QuadPart;
+
+    hMapping = CreateFileMappingA(hFile, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    if (hMapping == NULL)
+    {
+        CloseHandle(hFile);
+        return ERROR_CANNOT_OPEN_FILE;
+    }
+
+    pBase = (unsigned char *)MapViewOfFile(hMapping, FILE_MAP_COPY, 0, 0, 0);
+    if (pBase == NULL)
+    {
+        CloseHandle(hMapping);
+        CloseHandle(hFile);
+        return ERROR_CANNOT_OPEN_FILE;
+    }
+
+    pView->hFile = hFile;
+    pView->hMapping = hMapping;
+#else
+    struct stat st;
+    int fd;
+
+    fd = open(fileName, O_RDONLY);
+    if (fd < 0)
+        return ERROR_CANNOT_OPEN_FILE;
+
+    if (fstat(fd, &st) < 0 || st.st_size == 0 || st.st_size > MAX_FIRMWARE_BYTES)
+    {
+        close(fd);
+        return ERROR_WRONG_PARAMS;
+    }
+    fileSize = st.st_size;
+
+    pBase = (unsigned char *)mmap(NULL, fileSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping keeps the file referenced
+    if (pBase == MAP_FAILED)
+        return ERROR_CANNOT_OPEN_FILE;
+#endif
+
+    pView->pBase = pBase;
+    pView->size = (uint32)fileSize;
+
+    ret = DLPC350_Frmw_LocateFlashTable(pView->pBase, pView->size, &pView->flashTableAddress);
+    if (ret < 0)
+    {
+        DLPC350_FrmwView_Close(pView);
+        return ret;
+    }
+    pView->pFlashTable = (const FLASH_TABLE *)(pView->pBase + pView->flashTableAddress);
+
+    if (FrmwView_AddressToOffset(pView, pView->pFlashTable->Splash_Data[FLASH_TABLE_SPLASH_INDEX].Address,
+                                 sizeof(SPLASH_SUPER_BINARY_INFO), &splashAddress) == 0)
+        pView->splashAddress = splashAddress;
+
+    return 0;
+}
+
+void DLPC350_FrmwView_Close(DLPC350_FRMW_VIEW *pView)
+/**
+ * Unmaps the image. Spans and pointers obtained from the view are invalid afterwards.
+ *
+ * @param   pView - I - view opened with DLPC350_FrmwView_Open()
+ *
+ */
+{
+    if (pView->pBase != NULL)
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(pView->pBase);
+        CloseHandle((HANDLE)pView->hMapping);
+        CloseHandle((HANDLE)pView->hFile);
+#else
+        munmap(pView->pBase, pView->size);
+#endif
+    }
+
+    memset(pView, 0, sizeof(*pView));
+}
+
+int DLPC350_FrmwView_GetBlock(const DLPC350_FRMW_VIEW *pView, const FLASH_BLOCK *pBlock, DLPC350_SPAN *pSpan)
+/**
+ * Returns the bytes of a flash table block.
+ *
+ * @param   pView - I - view
+ * @param   pBlock - I - block of the flash table, e.g. &pView->pFlashTable->Sequence[0]
+ * @param   pSpan - O - block data inside the mapped image
+ *
+ * @return  0 = PASS
+ *          <0 = FAIL
+ *
+ */
+{
+    uint32 offset;
+
+    if (pView->pBase == NULL)
+        return ERROR_INIT_NOT_DONE_PROPERLY;
+
+    if (pBlock->Address == 0xFFFFFFFF || pBlock->ByteCount == 0xFFFFFFFF)
+        return ERROR_WRONG_PARAMS;
+
+    if (FrmwView_AddressToOffset(pView, pBlock->Address, pBlock->ByteCount, &offset) < 0)
+        return ERROR_OUT_OF_BOUNDS;
+
+    pSpan->pData = pView->pBase + offset;
+    pSpan->size = pBlock->ByteCount;
+    return 0;
+}
+
+int DLPC350_FrmwView_GetApplConfig(const DLPC350_FRMW_VIEW *pView, DLPC350_SPAN *pSpan)
+/**
+ * Returns the application configuration data (the block DLPC350_Frmw_WriteApplConfigData() edits).
+ *
+ * @return  0 = PASS
+ *          <0 = FAIL
+ *
+ */
+{
+    if (pView->pBase == NULL)
+        return ERROR_INIT_NOT_DONE_PROPERLY;
+
+    return DLPC350_FrmwView_GetBlock(pView, &pView->pFlashTable->APPL_Config_Data[0], pSpan);
+}
+
+int DLPC350_FrmwView_GetSplashCount(const DLPC350_FRMW_VIEW *pView)
+/**
+ * @return  number of splash blobs of an image built with DLPC350_CONFIG.exe
+ *          <0 = FAIL
+ *
+ */
+{
+    SPLASH_SUPER_BINARY_INFO binary_info;
+
+    if (pView->pBase == NULL || pView->splashAddress == 0)
+        return ERROR_NO_SPLASH_IMAGE;
+
+    memcpy(&binary_info, pView->pBase + pView->splashAddress, sizeof(binary_info));
+
+    if ((binary_info.Sig1 != 0x12345678) || (binary_info.Sig2 != 0x87654321))
+        return ERROR_NO_SPLASH_IMAGE;
+
+    if (binary_info.BlobCount > MAX_SPLASH_IMAGES ||
+        pView->splashAddress + sizeof(binary_info) + binary_info.BlobCount * sizeof(SPLASH_BLOB_INFO) > pView->size)
+        return ERROR_OUT_OF_BOUNDS;
+
+    return binary_info.BlobCount;
+}
+
+int DLPC350_FrmwView_GetSplash(const DLPC350_FRMW_VIEW *pView, int index, const SPLASH_HEADER **ppHeader, DLPC350_SPAN *pData)
+/**
+ * Returns the header and the (possibly compressed) pixel data of a splash image, without decoding or copying.
+ *
+ * @param   pView - I - view
+ * @param   index - I - splash index
+ * @param   ppHeader - O - splash header inside the mapped image
+ * @param   pData - O - pixel data following the header
+ *
+ * @return  0 = PASS
+ *          <0 = FAIL
+ *
+ */
+{
+    SPLASH_BLOB_INFO blob_info;
+    uint32 offset;
+    int count;
+
+    count = DLPC350_FrmwView_GetSplashCount(pView);
+    if (count < 0)
+        return count;
+    if (index < 0 || index >= count)
+        return ERROR_WRONG_PARAMS;
+
+    memcpy(&blob_info, pView->pBase + pView->splashAddress + sizeof(SPLASH_SUPER_BINARY_INFO) + index * sizeof(blob_info), sizeof(blob_info));
+
+    if (blob_info.BlobOffset == 0xFFFFFFFF)
+        return ERROR_NO_SPLASH_IMAGE;
+
+    if (blob_info.BlobSize < sizeof(SPLASH_HEADER) ||
+        FrmwView_AddressToOffset(pView, blob_info.BlobOffset, blob_info.BlobSize, &offset) < 0)
+        return ERROR_OUT_OF_BOUNDS;
+
+    *ppHeader = (const SPLASH_HEADER *)(pView->pBase + offset);
+    pData->pData = pView->pBase + offset + sizeof(SPLASH_HEADER);
+    pData->size = blob_info.BlobSize - sizeof(SPLASH_HEADER);
+    return 0;
+}
+
+unsigned char *DLPC350_FrmwView_GetWritable(DLPC350_FRMW_VIEW *pView, uint32 offset, uint32 size)
+/**
+ * Returns a writable pointer to [offset, offset + size) of the image.
+ * Only the pages actually written get private copies; the file itself is never changed.
+ *
+ * @param   pView - I - view
+ * @param   offset - I - byte offset in the image
+ * @param   size - I - number of bytes to be modified
+ *
+ * @return  pointer into the mapped image
+ *          NULL = out of bounds
+ *
+ */
+{
+    if (pView->pBase == NULL || offset > pView->size || size > pView->size - offset)
+        return NULL;
+
+    return pView->pBase + offset;
+}
+
+int DLPC350_FrmwView_Save(const DLPC350_FRMW_VIEW *pView, const char *fileName)
+/**
+ * Writes the image, including modified regions, to a file. The file must not be the one the view maps.
+ *
+ * @return  0 = PASS
+ *          <0 = FAIL
+ *
+ */
+{
+    FILE *fp;
+    size_t written;
+
+    if (pView->pBase == NULL)
+        return ERROR_INIT_NOT_DONE_PROPERLY;
+
+    fp = fopen(fileName, "wb");
+    if (fp == NULL)
+        return ERROR_CANNOT_OPEN_FILE;
+
+    written = fwrite(pView->pBase, 1, pView->size, fp);
+    if (fclose(fp) != 0 || written != pView->size)
+        return ERROR_CANNOT_OPEN_FILE;
+
+    return 0;
+}
@@ -0,0 +1,40 @@
+﻿/*
+ * dlpc350_firmwareView.h
+ *
+ * This module gives read access to a firmware image file through a private memory mapping,
+ * without copying the image. Modified regions are copied on write by the OS, page by page.
+ *
+*/
+
+#ifndef DLPC350_FIRMWAREVIEW_H
+#define DLPC350_FIRMWAREVIEW_H
+
+#include "dlpc350_common.h"
+#include "dlpc350_firmware.h"
+
+typedef struct
+{
+    const unsigned char *pData;
+    uint32 size;
+} DLPC350_SPAN;
+
+typedef struct
+{
+    unsigned char *pBase;               /* copy-on-write mapping of the whole file */
+    uint32 size;
+    const FLASH_TABLE *pFlashTable;
+    uint32 flashTableAddress;           /* offset of the flash table in the image */
+    uint32 splashAddress;               /* offset of the splash super binary, 0 if none */
+    void *hFile;                        /* HANDLE on Windows, file descriptor otherwise */
+    void *hMapping;
+} DLPC350_FRMW_VIEW;
+
+int DLPC350_FrmwView_Open(DLPC350_FRMW_VIEW *pView, const char *fileName);
+void DLPC350_FrmwView_Close(DLPC350_FRMW_VIEW *pView);
+int DLPC350_FrmwView_GetBlock(const DLPC350_FRMW_VIEW *pView, const FLASH_BLOCK *pBlock, DLPC350_SPAN *pSpan);
+int DLPC350_FrmwView_GetApplConfig(const DLPC350_FRMW_VIEW *pView, DLPC350_SPAN *pSpan);
+int DLPC350_FrmwView_GetSplashCount(const DLPC350_FRMW_VIEW *pView);
+int DLPC350_FrmwView_GetSplash(const DLPC350_FRMW_VIEW *pView, int index, const SPLASH_HEADER **ppHeader, DLPC350_SPAN *pData);
+unsigned char *DLPC350_FrmwView_GetWritable(DLPC350_FRMW_VIEW *pView, uint32 offset, uint32 size);
+int DLPC350_FrmwView_Save(const DLPC350_FRMW_VIEW *pView, const char *fileName);
+#endif
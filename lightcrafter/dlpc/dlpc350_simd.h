@@ -0,0 +1,95 @@
+﻿/*
+ * dlpc350_simd.h
+ *
+ * CPU feature detection for the vectorized image routines. Kernels are compiled for their
+ * instruction set with DLPC350_TARGET() and selected at runtime, so the rest of the build
+ * needs no architecture flags.
+ *
+*/
+
+#ifndef DLPC350_SIMD_H
+#define DLPC350_SIMD_H
+
+#define CPU_FEATURE_SSE2            0x01
+#define CPU_FEATURE_SSSE3           0x02
+#define CPU_FEATURE_SSE41           0x04
+#define CPU_FEATURE_AVX2            0x08
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define DLPC350_SIMD_X86            1
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define DLPC350_TARGET(isa)
+#else
+#include <cpuid.h>
+#define DLPC350_TARGET(isa)         __attribute__((target(isa)))
+#endif
+#include <immintrin.h>
+
+static inline void DLPC350_CpuId(int leaf, int subleaf, unsigned int regs[4])
+{
+#ifdef _MSC_VER
+    __cpuidex((int *)regs, leaf, subleaf);
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static inline unsigned long long DLPC350_XGetBV()
+{
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    unsigned int eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((unsigned long long)edx << 32) | eax;
+#endif
+}
+
+static inline unsigned int DLPC350_DetectCpuFeatures()
+{
+    unsigned int regs[4], maxLeaf, features = 0;
+
+    DLPC350_CpuId(0, 0, regs);
+    maxLeaf = regs[0];
+    if (maxLeaf < 1)
+        return 0;
+
+    DLPC350_CpuId(1, 0, regs);
+    if (regs[3] & (1u << 26))
+        features |= CPU_FEATURE_SSE2;
+    if (regs[2] & (1u << 9))
+        features |= CPU_FEATURE_SSSE3;
+    if (regs[2] & (1u << 19))
+        features |= CPU_FEATURE_SSE41;
+
+    /* AVX2 also needs the OS to save the YMM state (OSXSAVE and XCR0 bits 1-2) */
+    if ((regs[2] & (1u << 27)) && (DLPC350_XGetBV() & 0x6) == 0x6 && maxLeaf >= 7)
+    {
+        DLPC350_CpuId(7, 0, regs);
+        if (regs[1] & (1u << 5))
+            features |= CPU_FEATURE_AVX2;
+    }
+
+    return features;
+}
+
+#else
+#define DLPC350_SIMD_X86            0
+#define DLPC350_TARGET(isa)
+
+static inline unsigned int DLPC350_DetectCpuFeatures()
+{
+    return 0;
+}
+#endif
+
+/* CPU_FEATURE_* bits of the running CPU, detected once */
+static inline unsigned int DLPC350_CpuFeatures()
+{
+    static const unsigned int features = DLPC350_DetectCpuFeatures();
+    return features;
+}
+
+#endif